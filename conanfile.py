@@ -21,6 +21,8 @@ class ChangeMeRecipe(ConanFile):
         self.requires("nlohmann_json/3.11.3")
         self.requires("rapidjson/cci.20230929")
         self.requires("cli11/2.4.2")
+        self.requires("zlib/1.3.1")
+        self.requires("zstd/1.5.5")
         # self.requires("glad/0.1.36")
         # conditional requires (it happens too often)
         # if (self.settings.os != 'Windows'): 
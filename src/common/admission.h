@@ -0,0 +1,367 @@
+#ifndef COMMON_ADMISSION_H
+#define COMMON_ADMISSION_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <unordered_map>
+#include <list>
+#include <optional>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <CLI/CLI.hpp>
+
+#include <pistache/http.h>
+#include <pistache/http_headers.h>
+#include <pistache/mime.h>
+#include <pistache/peer.h>
+
+#include "encoded_response.h"
+
+namespace common {
+
+// Limits on what a service takes on, all of them off by default. Requests over
+// them are answered right away, 429 for a client over its rate, 503 when the
+// service as a whole is busy, both with Retry-After, instead of being queued.
+struct AdmissionOptions {
+    // Requests a second per client, unlimited if 0.
+    double rate = 0;
+    // Requests a client may send at once after being idle, `rate` if 0.
+    double burst = 0;
+    // Requests handled at once, unlimited if 0.
+    std::size_t max_in_flight = 0;
+    // Handling slower than this shrinks the in-flight limit, not watched if 0.
+    uint target_latency_ms = 0;
+    // Clients tracked at once, the least recently seen is forgotten first.
+    std::size_t max_clients = 65536;
+
+    bool enabled() const noexcept {
+        return rate > 0 || max_in_flight > 0 || target_latency_ms > 0;
+    }
+};
+
+inline void addAdmissionOptions(CLI::App& app, AdmissionOptions& options) {
+    app.add_option("--rate-limit", options.rate, "Requests a second per client (authenticated user or address), unlimited if 0.");
+    app.add_option("--rate-burst", options.burst, "Requests a client may burst after being idle, the rate limit if 0.");
+    app.add_option("--max-in-flight", options.max_in_flight, "Requests handled at once, more are refused with 503.");
+    app.add_option("--target-latency-ms", options.target_latency_ms, "Handling slower than this lowers the in-flight limit until it's fast again.");
+    app.add_option("--max-clients", options.max_clients, "Clients whose rate is tracked at once, the least recently seen is forgotten first.");
+}
+
+// Refills continuously at `rate` tokens a second up to `burst`, a request takes one.
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double burst, Clock::time_point now)
+        : _tokens(burst),
+          _updated(now) {}
+
+    // Zero if a token was taken, otherwise how long until there's one.
+    Clock::duration take(double rate, double burst, Clock::time_point now) {
+        refill(rate, burst, now);
+        if (_tokens >= 1) {
+            _tokens -= 1;
+            return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - _tokens) / rate));
+    }
+
+private:
+    void refill(double rate, double burst, Clock::time_point now) {
+        const std::chrono::duration<double> elapsed = now - _updated;
+        _tokens = std::min(burst, _tokens + elapsed.count() * rate);
+        _updated = now;
+    }
+
+    double _tokens;
+    Clock::time_point _updated;
+};
+
+// Token bucket per client. Buckets are spread over shards of their own lock so
+// reactor threads seldom meet. A shard full of clients makes room by dropping
+// the one seen least recently, a bucket in use is never reset to let a new one in.
+class RateLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+
+    static constexpr std::size_t shard_count = 16;
+
+    RateLimiter(double rate, double burst, std::size_t max_clients)
+        : _rate(rate),
+          _burst(burst > 0 ? burst : std::max(rate, 1.0)),
+          _max_per_shard(std::max<std::size_t>(max_clients / shard_count, 1)) {}
+
+    // Zero if client may go on, otherwise how long it should wait.
+    Clock::duration take(const std::string& client, Clock::time_point now = Clock::now()) {
+        auto& shard = _shards[std::hash<std::string>{}(client) % shard_count];
+        std::lock_guard<std::mutex> lock(shard.m);
+        auto it = shard.index.find(client);
+        if (it != shard.index.end()) {
+            shard.recent.splice(shard.recent.begin(), shard.recent, it->second);
+        } else {
+            if (shard.index.size() >= _max_per_shard) {
+                shard.index.erase(shard.recent.back().first);
+                shard.recent.pop_back();
+            }
+            shard.recent.emplace_front(client, TokenBucket(_burst, now));
+            it = shard.index.emplace(client, shard.recent.begin()).first;
+        }
+        return it->second->second.take(_rate, _burst, now);
+    }
+
+private:
+    using Recent = std::list<std::pair<std::string, TokenBucket>>;
+
+    struct alignas(64) Shard {
+        std::mutex m;
+        // Most recently seen first.
+        Recent recent;
+        std::unordered_map<std::string, Recent::iterator> index;
+    };
+
+    double _rate;
+    double _burst;
+    std::size_t _max_per_shard;
+    std::array<Shard, shard_count> _shards;
+};
+
+// Bounds requests handled at once. With a target latency the bound adapts: an
+// interval in which even the fastest request took longer than the target means
+// requests are queueing, the limit is cut by a quarter, otherwise it grows by a
+// sixteenth back up to the maximum. What doesn't fit is refused at once, so
+// latency and memory stay flat under overload while throughput stays at the plateau.
+class ConcurrencyLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto interval = std::chrono::milliseconds(100);
+    static constexpr std::size_t min_limit = 4;
+    // Ceiling when only latency is watched.
+    static constexpr std::size_t default_limit = 1024;
+
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(ConcurrencyLimiter* limiter, Clock::time_point start) : _limiter(limiter), _start(start) {}
+        Ticket(Ticket&& other) noexcept : _limiter(std::exchange(other._limiter, nullptr)), _start(other._start) {}
+        Ticket& operator=(Ticket&&) = delete;
+        ~Ticket() {
+            if (_limiter) {
+                _limiter->leave(_start, Clock::now());
+            }
+        }
+
+        explicit operator bool() const noexcept {
+            return _limiter != nullptr;
+        }
+
+    private:
+        ConcurrencyLimiter* _limiter = nullptr;
+        Clock::time_point _start;
+    };
+
+    ConcurrencyLimiter(std::size_t max_in_flight, std::chrono::milliseconds target_latency)
+        : _max(max_in_flight > 0 ? max_in_flight : target_latency.count() > 0 ? default_limit : SIZE_MAX),
+          _target(target_latency),
+          _limit(_max),
+          _window_start(Clock::now().time_since_epoch().count()) {}
+
+    // Empty ticket if the request has to be refused. Latency is counted from
+    // start, the request's arrival, so time spent waiting for a thread counts too.
+    Ticket enter(Clock::time_point start = Clock::now()) {
+        if (_in_flight.fetch_add(1, std::memory_order_acq_rel) >= _limit.load(std::memory_order_relaxed)) {
+            _in_flight.fetch_sub(1, std::memory_order_acq_rel);
+            return {};
+        }
+        return { this, start };
+    }
+
+    std::size_t limit() const noexcept {
+        return _limit.load(std::memory_order_relaxed);
+    }
+
+private:
+    void leave(Clock::time_point start, Clock::time_point now) {
+        _in_flight.fetch_sub(1, std::memory_order_acq_rel);
+        if (_target.count() == 0) {
+            return;
+        }
+        const auto latency = (now - start).count();
+        auto fastest = _window_fastest.load(std::memory_order_relaxed);
+        while (latency < fastest && !_window_fastest.compare_exchange_weak(fastest, latency, std::memory_order_relaxed)) {
+        }
+
+        // One thread a time closes the interval, others just carry on.
+        auto window_start = _window_start.load(std::memory_order_relaxed);
+        if (now.time_since_epoch().count() - window_start < Clock::duration(interval).count()
+            || !_window_start.compare_exchange_strong(window_start, now.time_since_epoch().count())) {
+            return;
+        }
+        fastest = _window_fastest.exchange(INT64_MAX, std::memory_order_relaxed);
+        const auto limit = _limit.load(std::memory_order_relaxed);
+        if (fastest > Clock::duration(_target).count()) {
+            _limit.store(std::max(std::min(min_limit, _max), limit - limit / 4), std::memory_order_relaxed);
+        } else if (limit < _max) {
+            _limit.store(std::min(_max, limit + std::max<std::size_t>(1, limit / 16)), std::memory_order_relaxed);
+        }
+    }
+
+    const std::size_t _max;
+    const std::chrono::milliseconds _target;
+    std::atomic<std::size_t> _limit;
+    std::atomic<std::size_t> _in_flight{ 0 };
+    // Clock ticks, so they fit in a lock-free atomic.
+    std::atomic<int64_t> _window_start;
+    std::atomic<int64_t> _window_fastest{ INT64_MAX };
+};
+
+// Identity of a request's user once its credentials check out, none otherwise.
+using Authenticator = std::function<std::optional<std::string>(const Pistache::Http::Request&)>;
+
+// Who a request is charged to: its user if authenticate vouches for one, its
+// address otherwise. Credentials nobody checked don't count, a client would
+// get a fresh bucket with every made up Authorization header.
+inline std::string clientKey(const Pistache::Http::Request& request, const Authenticator& authenticate = {}) {
+    if (authenticate) {
+        if (auto user = authenticate(request); user.has_value()) {
+            return "user:" + *std::move(user);
+        }
+    }
+    return request.address().host();
+}
+
+inline void refuse(Pistache::Http::ResponseWriter& response, Pistache::Http::Code code,
+                   std::chrono::steady_clock::duration retry_after, const std::string& reason) {
+    const auto seconds = std::max<int64_t>(1, static_cast<int64_t>(std::ceil(std::chrono::duration<double>(retry_after).count())));
+    response.headers().addRaw(Pistache::Http::Header::Raw("Retry-After", std::to_string(seconds)));
+    response.send(code, reason, MIME(Text, Plain));
+}
+
+namespace detail {
+
+// Ticket of the request whose handler runs on this thread.
+inline thread_local ConcurrencyLimiter::Ticket* current_admission = nullptr;
+
+// Makes ticket the current one for the handler call.
+class AdmissionScope {
+public:
+    explicit AdmissionScope(ConcurrencyLimiter::Ticket& ticket) {
+        current_admission = &ticket;
+    }
+    ~AdmissionScope() {
+        current_admission = nullptr;
+    }
+
+    AdmissionScope(const AdmissionScope&) = delete;
+    AdmissionScope& operator=(const AdmissionScope&) = delete;
+};
+
+}
+
+// Holds the request being handled on this thread in flight past its handler's
+// return, until the hold is let go of. For handlers answering later from a
+// continuation, which keeps the hold next to the writer. Streams and long polls
+// don't take one, they'd count for as long as their client stays connected.
+// Empty if there's nothing to hold, eg. when no limit is set.
+using AdmissionHold = std::shared_ptr<ConcurrencyLimiter::Ticket>;
+
+inline AdmissionHold holdAdmission() {
+    auto* current = std::exchange(detail::current_admission, nullptr);
+    if (current == nullptr) {
+        return nullptr;
+    }
+    return std::make_shared<ConcurrencyLimiter::Ticket>(std::move(*current));
+}
+
+// Wraps the handler of an endpoint, usually the router's, and admits requests
+// to it per AdmissionOptions. A request is in flight from the first bytes of
+// it read until its handler returns, or until the hold is let go of if the
+// handler took one with holdAdmission().
+class AdmissionHandler : public Pistache::Http::Handler {
+public:
+    using Clock = ConcurrencyLimiter::Clock;
+
+    struct State {
+        RateLimiter rate;
+        ConcurrencyLimiter concurrency;
+        bool limit_rate;
+        Authenticator authenticate;
+
+        State(const AdmissionOptions& options, Authenticator authenticator = {})
+            : rate(options.rate, options.burst, options.max_clients),
+              concurrency(options.max_in_flight, std::chrono::milliseconds(options.target_latency_ms)),
+              limit_rate(options.rate > 0),
+              authenticate(std::move(authenticator)) {}
+    };
+
+    AdmissionHandler(std::shared_ptr<Pistache::Http::Handler> handler, std::shared_ptr<State> state)
+        : _handler(std::move(handler)),
+          _state(std::move(state)) {}
+
+    // Every reactor thread gets a clone of the wrapped handler too, limits are shared.
+    std::shared_ptr<Pistache::Tcp::Handler> clone() const override {
+        return std::make_shared<AdmissionHandler>(
+            std::static_pointer_cast<Pistache::Http::Handler>(_handler->clone()),
+            _state
+        );
+    }
+
+    // A request read in several parts arrived with the first of them.
+    void onInput(const char* buffer, size_t length, const std::shared_ptr<Pistache::Tcp::Peer>& peer) override {
+        _arrivals.try_emplace(peer.get(), Clock::now());
+        Pistache::Http::Handler::onInput(buffer, length, peer);
+    }
+
+    void onDisconnection(const std::shared_ptr<Pistache::Tcp::Peer>& peer) override {
+        _arrivals.erase(peer.get());
+        Pistache::Http::Handler::onDisconnection(peer);
+    }
+
+    void onRequest(const Pistache::Http::Request& request, Pistache::Http::ResponseWriter response) override {
+        const auto arrived = takeArrival(response);
+        if (_state->limit_rate) {
+            if (const auto wait = _state->rate.take(clientKey(request, _state->authenticate)); wait > Clock::duration::zero()) {
+                refuse(response, Pistache::Http::Code::Too_Many_Requests, wait, "Rate limit exceeded");
+                return;
+            }
+        }
+        auto ticket = _state->concurrency.enter(arrived);
+        if (!ticket) {
+            refuse(response, Pistache::Http::Code::Service_Unavailable, std::chrono::seconds(1), "Server is busy");
+            return;
+        }
+        const detail::AdmissionScope scope(ticket);
+        _handler->onRequest(request, std::move(response));
+    }
+
+private:
+    // Requests after the first one of a read had arrived by the time it was handled.
+    Clock::time_point takeArrival(const Pistache::Http::ResponseWriter& response) {
+        const auto peer = response.peer();
+        const auto arrival = _arrivals.find(peer.get());
+        if (arrival == _arrivals.end()) {
+            return Clock::now();
+        }
+        const auto arrived = arrival->second;
+        _arrivals.erase(arrival);
+        return arrived;
+    }
+
+    std::shared_ptr<Pistache::Http::Handler> _handler;
+    std::shared_ptr<State> _state;
+    // Peers with a request read in part, by the time its first part was.
+    // A clone serves a single reactor thread, so it's not synchronized.
+    std::unordered_map<const Pistache::Tcp::Peer*, Clock::time_point> _arrivals;
+};
+
+}
+
+#endif
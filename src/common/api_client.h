@@ -0,0 +1,187 @@
+#ifndef COMMON_API_CLIENT_H
+#define COMMON_API_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+#include <iterator>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <pistache/async.h>
+#include <pistache/client.h>
+#include <pistache/http.h>
+#include <pistache/mime.h>
+
+namespace common {
+
+// Answer of a call outside of 2xx, carrying the status and what server said.
+struct ApiError : std::runtime_error {
+    Pistache::Http::Code code;
+    std::string body;
+
+    ApiError(Pistache::Http::Code code, std::string body)
+        : std::runtime_error(fmt::format("{} {}", static_cast<int>(code), body)),
+          code(code),
+          body(std::move(body)) {}
+};
+
+struct ClientOptions {
+    // Kept-alive connections to every host, requests over that wait for a free one.
+    int connections_per_host = 8;
+    int threads = 1;
+    std::chrono::milliseconds timeout{ 5000 };
+};
+
+// Percent-encodes everything but RFC 3986 unreserved characters, for query values and path segments.
+inline std::string urlEncode(std::string_view value) {
+    std::string encoded;
+    encoded.reserve(value.size());
+    for (const auto c : value) {
+        const auto byte = static_cast<unsigned char>(c);
+        if ((byte >= 'a' && byte <= 'z') || (byte >= 'A' && byte <= 'Z') || (byte >= '0' && byte <= '9')
+            || c == '-' || c == '.' || c == '_' || c == '~') {
+            encoded += c;
+        } else {
+            fmt::format_to(std::back_inserter(encoded), "%{:02X}", byte);
+        }
+    }
+    return encoded;
+}
+
+// Handle to a pool of kept-alive connections with a reactor thread of its own.
+// Copies share the pool, which shuts down with the last of them. Calls return
+// promises settled on the reactor thread, they don't block and any number of
+// them may be in flight at once, up to connections_per_host actually on the
+// wire to one host, rest queued by the pool for the next free connection.
+// Drop the last handle outside of response callbacks, shutdown joins the reactor.
+class ApiClient {
+public:
+    using Client = Pistache::Http::Experimental::Client;
+    using Headers = std::vector<std::shared_ptr<Pistache::Http::Header::Header>>;
+    template<typename T>
+    using Promise = Pistache::Async::Promise<T>;
+
+    explicit ApiClient(ClientOptions options = {})
+        : _client(makeClient(options)),
+          _options(options) {}
+
+    // Pool shared by everyone in the process asking for it, as long as someone holds it.
+    // Options only matter to whoever creates it.
+    static ApiClient shared(ClientOptions options = {}) {
+        static std::mutex m;
+        static std::weak_ptr<Client> pool;
+        std::lock_guard<std::mutex> lock(m);
+        auto client = pool.lock();
+        if (!client) {
+            client = makeClient(options);
+            pool = client;
+        }
+        return ApiClient(std::move(client), options);
+    }
+
+    const ClientOptions& options() const noexcept {
+        return _options;
+    }
+
+    // Same pool, different deadline, eg. for long polls.
+    ApiClient withTimeout(std::chrono::milliseconds timeout) const {
+        auto copy = *this;
+        copy._options.timeout = timeout;
+        return copy;
+    }
+
+    // Non-empty bodies go as JSON.
+    Promise<Pistache::Http::Response> send(
+        Pistache::Http::Method method, const std::string& url, std::string body = {}, const Headers& headers = {}
+    ) const {
+        auto request = builder(method, url);
+        request.timeout(_options.timeout);
+        if (!body.empty()) {
+            request.header(std::make_shared<Pistache::Http::Header::ContentType>(MIME(Application, Json)));
+            request.body(std::move(body));
+        }
+        for (const auto& header : headers) {
+            request.header(header);
+        }
+        return request.send();
+    }
+
+    // Body of a 2xx response, ApiError otherwise.
+    Promise<std::string> text(
+        Pistache::Http::Method method, const std::string& url, std::string body = {}, const Headers& headers = {}
+    ) const {
+        return send(method, url, std::move(body), headers).then(
+            [](const Pistache::Http::Response& response) {
+                const auto code = static_cast<int>(response.code());
+                if (code < 200 || code >= 300) {
+                    throw ApiError(response.code(), response.body());
+                }
+                return response.body();
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    // 2xx response body parsed as T, null counts as an empty T.
+    template<typename T>
+    Promise<T> json(
+        Pistache::Http::Method method, const std::string& url, std::string body = {}, const Headers& headers = {}
+    ) const {
+        return text(method, url, std::move(body), headers).then(
+            [](const std::string& text) {
+                const auto json = nlohmann::json::parse(text);
+                return json.is_null() ? T{} : json.template get<T>();
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    // Settles once every call did, results in the order of calls, or with the first failure.
+    template<typename T>
+    static Promise<std::vector<T>> all(std::vector<Promise<T>> calls) {
+        return Pistache::Async::whenAll(calls.begin(), calls.end());
+    }
+
+private:
+    ApiClient(std::shared_ptr<Client> client, ClientOptions options)
+        : _client(std::move(client)),
+          _options(options) {}
+
+    static std::shared_ptr<Client> makeClient(const ClientOptions& options) {
+        std::shared_ptr<Client> client(new Client(), [](Client* client) {
+            client->shutdown();
+            delete client;
+        });
+        client->init(
+            Client::options()
+                .threads(options.threads)
+                .maxConnectionsPerHost(options.connections_per_host)
+                .keepAlive(true)
+        );
+        return client;
+    }
+
+    Pistache::Http::Experimental::RequestBuilder builder(Pistache::Http::Method method, const std::string& url) const {
+        switch (method) {
+        case Pistache::Http::Method::Post:   return _client->post(url);
+        case Pistache::Http::Method::Put:    return _client->put(url);
+        case Pistache::Http::Method::Patch:  return _client->patch(url);
+        case Pistache::Http::Method::Delete: return _client->del(url);
+        default:                             return _client->get(url);
+        }
+    }
+
+    std::shared_ptr<Client> _client;
+    ClientOptions _options;
+};
+
+}
+
+#endif
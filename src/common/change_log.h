@@ -0,0 +1,151 @@
+#ifndef COMMON_CHANGE_LOG_H
+#define COMMON_CHANGE_LOG_H
+
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <functional>
+#include <mutex>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "expected.h"
+
+namespace common {
+
+enum class ChangeKind {
+    Create,
+    Update,
+    Delete
+};
+
+inline std::string_view name(ChangeKind kind) {
+    switch (kind) {
+    case ChangeKind::Create: return "create";
+    case ChangeKind::Update: return "update";
+    case ChangeKind::Delete: return "delete";
+    }
+    return "unknown";
+}
+
+// One row changed by a write. Ids are positions, as everywhere in the store,
+// so a delete shifts every row after it down by one.
+template<typename T>
+struct Change {
+    // Store version the write published, changes of one write share it.
+    uint64_t version;
+    ChangeKind kind;
+    std::size_t id;
+    // Row after the change, none for deletes.
+    std::optional<T> value;
+};
+
+template<typename T>
+void to_json(nlohmann::json& j, const Change<T>& change) {
+    j = nlohmann::json{
+        {"version", change.version},
+        {"op", name(change.kind)},
+        {"id", change.id}
+    };
+    if (change.value.has_value()) {
+        j["value"] = *change.value;
+    }
+}
+
+// Ordered stream of changes of a store, for consumers applying deltas instead
+// of downloading everything again. Keeps the latest `capacity` changes (whole
+// writes only) to be read back by version, and hands every write to listeners
+// as it's recorded. A consumer which fell behind what's kept starts over from
+// a snapshot and the version it was taken at.
+template<typename T>
+class ChangeLog {
+public:
+    using Listener = std::function<void(const std::vector<Change<T>>&)>;
+
+    // Changes after `version` and the latest version, which is where to continue from.
+    struct Page {
+        uint64_t version;
+        std::vector<Change<T>> changes;
+    };
+
+    explicit ChangeLog(uint64_t version = 0, std::size_t capacity = 65536)
+        : _capacity(capacity),
+          _oldest(version),
+          _latest(version) {}
+
+    // Listeners run on the writer's thread while it holds its lock, they mustn't block.
+    void listen(Listener listener) {
+        std::lock_guard<std::mutex> lock(_m);
+        _listeners.push_back(std::move(listener));
+    }
+
+    // Changes of a single write, all with the same version. Writers call it in
+    // version order, ie. under the lock which serializes them.
+    void record(std::vector<Change<T>> changes) {
+        if (changes.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_m);
+        _latest = changes.back().version;
+        for (const auto& listener : _listeners) {
+            listener(changes);
+        }
+        std::move(changes.begin(), changes.end(), std::back_inserter(_changes));
+        // Dropped a write at a time, a version is either all there or not at all.
+        while (_changes.size() > _capacity) {
+            _oldest = _changes.front().version;
+            while (!_changes.empty() && _changes.front().version == _oldest) {
+                _changes.pop_front();
+            }
+        }
+    }
+
+    void record(Change<T> change) {
+        record(std::vector<Change<T>>{ std::move(change) });
+    }
+
+    // Changes with a version newer than `version`, at least `limit` of them if
+    // there are so many, rounded up to a whole write. A version older than
+    // what's kept, or one this log never got to, is an error. Writers publish
+    // a version before recording its changes, so one up to `published`, the
+    // store's latest, is merely not recorded yet and gets an empty page.
+    Expected<Page> since(uint64_t version, std::size_t limit, uint64_t published = 0) const {
+        std::lock_guard<std::mutex> lock(_m);
+        if (version > _latest && version <= published) {
+            return Page{ version, {} };
+        }
+        if (version < _oldest || version > _latest) {
+            return Error{
+                Errc::Gone,
+                fmt::format("Changes after version {} aren't kept, start over from a snapshot (kept {}-{})", version, _oldest, _latest)
+            };
+        }
+        limit = std::max<std::size_t>(limit, 1);
+        const auto first = std::upper_bound(_changes.begin(), _changes.end(), version,
+            [](uint64_t version, const Change<T>& change) { return version < change.version; });
+        auto last = first;
+        for (std::size_t taken = 0; last != _changes.end() && (taken < limit || last->version == std::prev(last)->version); ++taken) {
+            ++last;
+        }
+        Page page{ last == first ? _latest : std::prev(last)->version, { first, last } };
+        return page;
+    }
+
+private:
+    std::size_t _capacity;
+    // Everything after _oldest up to _latest is kept.
+    uint64_t _oldest;
+    uint64_t _latest;
+    std::deque<Change<T>> _changes;
+    std::vector<Listener> _listeners;
+    mutable std::mutex _m;
+};
+
+}
+
+#endif
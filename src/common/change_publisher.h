@@ -0,0 +1,181 @@
+#ifndef COMMON_CHANGE_PUBLISHER_H
+#define COMMON_CHANGE_PUBLISHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stop_token>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "api_client.h"
+#include "change_log.h"
+
+namespace common {
+
+struct ChangeFeedOptions {
+    // Pub/Sub service changes are published to, eg. "localhost:9080", none if empty.
+    std::string publish_to;
+    std::string topic = "messages.changes";
+};
+
+// Forwards a ChangeLog to a topic of the Pub/Sub service (lab13). Messages
+// are {"author": source, "topic": topic, "contents": JSON array of changes}.
+// One publish is in flight at a time, so changes arrive in version order, and
+// whatever piled up meanwhile goes out together in the next one. A failed
+// publish is retried on a timer after a backoff doubling from min_backoff up
+// to max_backoff, changes arriving meanwhile wait for it. Beyond `max_pending` the oldest
+// changes are dropped, subscribers see a gap in versions and catch up with
+// GET /changes. Must outlive the calls it made.
+template<typename T>
+class ChangePublisher {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr Clock::duration min_backoff = std::chrono::milliseconds(100);
+    static constexpr Clock::duration max_backoff = std::chrono::seconds(30);
+
+    // Host as in "localhost:9080".
+    ChangePublisher(std::string host, std::string topic, std::string source,
+                    std::size_t max_pending = 65536, ApiClient http = ApiClient::shared())
+        : _url(fmt::format("{}/v1/publish", host)),
+          _topic(std::move(topic)),
+          _source(std::move(source)),
+          _max_pending(max_pending),
+          _http(std::move(http)),
+          _retrier([this](std::stop_token stop) { retry(stop); }) {}
+
+    ChangePublisher(const ChangePublisher&) = delete;
+    ChangePublisher& operator=(const ChangePublisher&) = delete;
+
+    // Meant as a ChangeLog listener, doesn't wait for anything.
+    void publish(const std::vector<Change<T>>& changes) {
+        std::unique_lock<std::mutex> lock(_m);
+        _pending.insert(_pending.end(), changes.begin(), changes.end());
+        if (_pending.size() > _max_pending) {
+            const auto dropped = _pending.size() - _max_pending;
+            spdlog::warn("Dropping {} changes not published to {}", dropped, _topic);
+            _pending.erase(_pending.begin(), _pending.begin() + static_cast<std::ptrdiff_t>(dropped));
+            _first += dropped;
+        }
+        sendPending(lock);
+    }
+
+private:
+    // Sends whatever is pending unless a publish is in flight already. The lock
+    // is let go of before sending, a promise settled at once calls back here.
+    void sendPending(std::unique_lock<std::mutex>& lock) {
+        if (_in_flight || _pending.empty() || Clock::now() < _retry_at) {
+            return;
+        }
+        _in_flight = true;
+        const auto end = _first + _pending.size();
+        const nlohmann::json message{
+            {"author", _source},
+            {"topic", _topic},
+            {"contents", nlohmann::json(_pending).dump()}
+        };
+        lock.unlock();
+
+        auto body = message.dump();
+        _http.send(Pistache::Http::Method::Post, _url, body).then(
+            [this, body, end](const Pistache::Http::Response& response) {
+                // Broker not owning the topic's partition points at the one which does.
+                if (response.code() == Pistache::Http::Code::Temporary_Redirect) {
+                    if (const auto location = response.headers().tryGet<Pistache::Http::Header::Location>(); location != nullptr) {
+                        _http.text(Pistache::Http::Method::Post, location->location(), body).then(
+                            [this, end](const std::string&) { acknowledged(end); },
+                            [this](std::exception_ptr error) { failed(error); }
+                        );
+                        return;
+                    }
+                }
+                const auto code = static_cast<int>(response.code());
+                if (code < 200 || code >= 300) {
+                    failed(std::make_exception_ptr(ApiError(response.code(), response.body())));
+                    return;
+                }
+                acknowledged(end);
+            },
+            [this](std::exception_ptr error) { failed(error); }
+        );
+    }
+
+    // Everything before `end` got there, some of it may have been dropped meanwhile.
+    void acknowledged(uint64_t end) {
+        std::unique_lock<std::mutex> lock(_m);
+        if (end > _first) {
+            _pending.erase(_pending.begin(), _pending.begin() + static_cast<std::ptrdiff_t>(end - _first));
+            _first = end;
+        }
+        _in_flight = false;
+        _backoff = Clock::duration::zero();
+        sendPending(lock);
+    }
+
+    // Left pending until the retry.
+    void failed(std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        } catch (const std::exception& e) {
+            spdlog::warn("Publishing changes to {} failed: {}", _topic, e.what());
+        } catch (...) {
+            spdlog::warn("Publishing changes to {} failed", _topic);
+        }
+        std::lock_guard<std::mutex> lock(_m);
+        _in_flight = false;
+        _backoff = std::clamp(2 * _backoff, min_backoff, max_backoff);
+        _retry_at = Clock::now() + _backoff;
+        _retry.notify_one();
+    }
+
+    // Timer thread, sends what's pending once a retry is due.
+    void retry(std::stop_token stop) {
+        std::unique_lock<std::mutex> lock(_m);
+        while (!stop.stop_requested()) {
+            if (_retry_at == Clock::time_point::min()) {
+                _retry.wait(lock, stop, [this] { return _retry_at != Clock::time_point::min(); });
+                continue;
+            }
+            const auto due = _retry_at;
+            if (_retry.wait_until(lock, stop, due, [&] { return _retry_at != due; }) || stop.stop_requested()) {
+                continue;
+            }
+            _retry_at = Clock::time_point::min();
+            sendPending(lock);
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+        }
+    }
+
+    std::string _url;
+    std::string _topic;
+    std::string _source;
+    std::size_t _max_pending;
+    ApiClient _http;
+    std::deque<Change<T>> _pending;
+    // Number of changes published or dropped before the first pending one.
+    uint64_t _first = 0;
+    bool _in_flight = false;
+    // Doubled by every failure in a row, nothing is sent before _retry_at.
+    Clock::duration _backoff = Clock::duration::zero();
+    Clock::time_point _retry_at = Clock::time_point::min();
+    std::mutex _m;
+    std::condition_variable_any _retry;
+    // Last, stopped and joined before anything it uses is gone.
+    std::jthread _retrier;
+};
+
+}
+
+#endif
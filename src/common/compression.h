@@ -0,0 +1,270 @@
+#ifndef COMMON_COMPRESSION_H
+#define COMMON_COMPRESSION_H
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+
+#include <fmt/format.h>
+
+#include <zlib.h>
+#ifdef COMMON_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace common {
+
+enum class Encoding {
+    Identity,
+    Gzip,
+    Zstd
+};
+
+struct CompressionOptions {
+    // Bodies smaller than this go out as they are, compressing them isn't worth it.
+    std::size_t threshold = 1024;
+    int gzip_level = 6;
+    int zstd_level = 3;
+};
+
+inline std::string_view name(Encoding encoding) noexcept {
+    switch (encoding) {
+    case Encoding::Gzip: return "gzip";
+    case Encoding::Zstd: return "zstd";
+    default:             return "identity";
+    }
+}
+
+inline bool supported(Encoding encoding) noexcept {
+#ifdef COMMON_WITH_ZSTD
+    return true;
+#else
+    return encoding != Encoding::Zstd;
+#endif
+}
+
+// Best supported encoding of an Accept-Encoding value, eg. "gzip;q=0.8, zstd".
+// Higher q wins, zstd is preferred over gzip on a tie.
+inline Encoding negotiate(std::string_view accept_encoding) {
+    Encoding best = Encoding::Identity;
+    double best_q = 0;
+    std::size_t begin = 0;
+    while (begin < accept_encoding.size()) {
+        const auto end = std::min(accept_encoding.find(',', begin), accept_encoding.size());
+        auto item = accept_encoding.substr(begin, end - begin);
+        begin = end + 1;
+
+        double q = 1;
+        if (const auto params = item.find(';'); params != std::string_view::npos) {
+            if (const auto q_pos = item.find("q=", params); q_pos != std::string_view::npos) {
+                q = std::strtod(std::string(item.substr(q_pos + 2)).c_str(), nullptr);
+            }
+            item = item.substr(0, params);
+        }
+        item.remove_prefix(std::min(item.find_first_not_of(' '), item.size()));
+        item = item.substr(0, item.find_last_not_of(' ') + 1);
+
+        Encoding encoding = Encoding::Identity;
+        if (item == "gzip" || item == "x-gzip") {
+            encoding = Encoding::Gzip;
+        } else if (item == "zstd") {
+            encoding = Encoding::Zstd;
+        } else {
+            continue;
+        }
+        if (supported(encoding) && q > 0 && (q > best_q || (q == best_q && encoding == Encoding::Zstd))) {
+            best = encoding;
+            best_q = q;
+        }
+    }
+    return best;
+}
+
+namespace detail {
+
+// Deflate state is a few hundred KiB, every thread keeps one and resets it per body.
+struct GzipContext {
+    z_stream stream{};
+    int level;
+
+    explicit GzipContext(int level) : level(level) {
+        if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Couldn't initialize gzip compressor");
+        }
+    }
+    ~GzipContext() {
+        deflateEnd(&stream);
+    }
+    GzipContext(const GzipContext&) = delete;
+    GzipContext& operator=(const GzipContext&) = delete;
+
+    std::string compress(std::string_view input, int wanted_level) {
+        deflateReset(&stream);
+        if (wanted_level != level) {
+            deflateParams(&stream, wanted_level, Z_DEFAULT_STRATEGY);
+            level = wanted_level;
+        }
+        std::string output(deflateBound(&stream, static_cast<uLong>(input.size())), '\0');
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = static_cast<uInt>(input.size());
+        stream.next_out = reinterpret_cast<Bytef*>(output.data());
+        stream.avail_out = static_cast<uInt>(output.size());
+        if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("gzip compression failed");
+        }
+        output.resize(stream.total_out);
+        return output;
+    }
+};
+
+}
+
+// Compressor contexts are thread_local, reused by every call made on that thread.
+inline std::string compress(Encoding encoding, std::string_view input, const CompressionOptions& options = {}) {
+    switch (encoding) {
+    case Encoding::Gzip: {
+        thread_local detail::GzipContext context(options.gzip_level);
+        return context.compress(input, options.gzip_level);
+    }
+#ifdef COMMON_WITH_ZSTD
+    case Encoding::Zstd: {
+        thread_local std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> context(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+        std::string output(ZSTD_compressBound(input.size()), '\0');
+        const auto size = ZSTD_compressCCtx(
+            context.get(), output.data(), output.size(), input.data(), input.size(), options.zstd_level
+        );
+        if (ZSTD_isError(size)) {
+            throw std::runtime_error(fmt::format("zstd compression failed: {}", ZSTD_getErrorName(size)));
+        }
+        output.resize(size);
+        return output;
+    }
+#endif
+    default:
+        return std::string(input);
+    }
+}
+
+// Thrown by decompress() when a body inflates past the limit it was given.
+struct BodyTooLarge : std::length_error {
+    using std::length_error::length_error;
+};
+
+// Output is produced a chunk at a time and never grows past max_size, so a
+// small body claiming or inflating to gigabytes costs no more than max_size.
+inline std::string decompress(Encoding encoding, std::string_view input, std::size_t max_size = SIZE_MAX) {
+    const auto too_large = [max_size] {
+        return BodyTooLarge(fmt::format("Body is larger than {} bytes decompressed", max_size));
+    };
+    switch (encoding) {
+    case Encoding::Gzip: {
+        z_stream stream{};
+        if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+            throw std::runtime_error("Couldn't initialize gzip decompressor");
+        }
+        std::string output;
+        std::array<char, 16 * 1024> chunk;
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        stream.avail_in = static_cast<uInt>(input.size());
+        int result = Z_OK;
+        while (result != Z_STREAM_END) {
+            stream.next_out = reinterpret_cast<Bytef*>(chunk.data());
+            stream.avail_out = static_cast<uInt>(chunk.size());
+            result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END) {
+                inflateEnd(&stream);
+                throw std::runtime_error("Malformed gzip body");
+            }
+            const auto produced = chunk.size() - stream.avail_out;
+            if (produced > max_size - output.size()) {
+                inflateEnd(&stream);
+                throw too_large();
+            }
+            output.append(chunk.data(), produced);
+        }
+        inflateEnd(&stream);
+        return output;
+    }
+#ifdef COMMON_WITH_ZSTD
+    case Encoding::Zstd: {
+        // Content size in the frame header is the client's word, not trusted for allocation.
+        const std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        if (!context) {
+            throw std::runtime_error("Couldn't initialize zstd decompressor");
+        }
+        // Windows up to 8 MiB cover every compression level but the ultra ones.
+        ZSTD_DCtx_setParameter(context.get(), ZSTD_d_windowLogMax, 23);
+        std::string output;
+        std::array<char, 16 * 1024> chunk;
+        ZSTD_inBuffer in{ input.data(), input.size(), 0 };
+        std::size_t remaining = 1;
+        while (remaining != 0) {
+            ZSTD_outBuffer out{ chunk.data(), chunk.size(), 0 };
+            remaining = ZSTD_decompressStream(context.get(), &out, &in);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(fmt::format("Malformed zstd body: {}", ZSTD_getErrorName(remaining)));
+            }
+            if (out.pos > max_size - output.size()) {
+                throw too_large();
+            }
+            output.append(chunk.data(), out.pos);
+            // Input used up and nothing more came out, the frame was cut short.
+            if (remaining != 0 && in.pos == in.size && out.pos == 0) {
+                throw std::runtime_error("Malformed zstd body: truncated");
+            }
+        }
+        return output;
+    }
+#endif
+    default:
+        if (input.size() > max_size) {
+            throw too_large();
+        }
+        return std::string(input);
+    }
+}
+
+// Serialized body together with its compressed forms. Every encoding is
+// produced at most once, on first request, so a body cached or fanned out to
+// many clients is compressed once and not per client.
+class EncodedBody {
+public:
+    explicit EncodedBody(std::string identity, CompressionOptions options = {})
+        : _identity(std::move(identity)),
+          _options(options) {}
+
+    const std::string& identity() const noexcept {
+        return _identity;
+    }
+
+    // Falls back to identity for small bodies and those compression didn't shrink.
+    std::pair<Encoding, const std::string&> encode(Encoding encoding) const {
+        if (encoding == Encoding::Identity || !supported(encoding) || _identity.size() < _options.threshold) {
+            return { Encoding::Identity, _identity };
+        }
+        const auto slot = static_cast<std::size_t>(encoding) - 1;
+        std::call_once(_once[slot], [&] {
+            _compressed[slot] = compress(encoding, _identity, _options);
+        });
+        if (_compressed[slot].size() >= _identity.size()) {
+            return { Encoding::Identity, _identity };
+        }
+        return { encoding, _compressed[slot] };
+    }
+
+private:
+    std::string _identity;
+    CompressionOptions _options;
+    mutable std::array<std::once_flag, 2> _once;
+    mutable std::array<std::string, 2> _compressed;
+};
+
+}
+
+#endif
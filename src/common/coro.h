@@ -0,0 +1,266 @@
+#ifndef COMMON_CORO_H
+#define COMMON_CORO_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <atomic>
+#include <utility>
+#include <type_traits>
+
+#include <pistache/async.h>
+
+namespace common {
+
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+// Value or failure a coroutine or promise settled with.
+template<typename T>
+struct Outcome {
+    std::optional<T> value;
+    std::exception_ptr error;
+
+    T get() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+template<>
+struct Outcome<void> {
+    std::exception_ptr error;
+
+    void get() const {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Suspends until the promise settles, awaiting coroutine is then resumed by
+// whoever settled it, for client calls that's the client's reactor thread.
+template<typename T>
+class PromiseAwaiter {
+public:
+    explicit PromiseAwaiter(Pistache::Async::Promise<T>&& promise) : _promise(std::move(promise)) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        _handle = handle;
+        auto rejected = [this](std::exception_ptr& e) {
+            _outcome.error = e;
+            settle();
+        };
+        if constexpr (std::is_void_v<T>) {
+            _promise.then([this] { settle(); }, std::move(rejected));
+        } else {
+            _promise.then([this](const T& value) { _outcome.value.emplace(value); settle(); }, std::move(rejected));
+        }
+        // Settled promise runs callbacks right in then(), no need to suspend then. Whichever
+        // of the two comes second carries on, neither touches the awaiter afterwards.
+        return !_settled.exchange(true, std::memory_order_acq_rel);
+    }
+    T await_resume() {
+        return _outcome.get();
+    }
+
+private:
+    void settle() {
+        if (_settled.exchange(true, std::memory_order_acq_rel)) {
+            _handle.resume();
+        }
+    }
+
+    Pistache::Async::Promise<T> _promise;
+    std::coroutine_handle<> _handle;
+    Outcome<T> _outcome;
+    std::atomic<bool> _settled{ false };
+};
+
+// Hands control back to whoever awaited the finished task.
+struct FinalAwaiter {
+    bool await_ready() const noexcept {
+        return false;
+    }
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        if (const auto continuation = handle.promise().continuation) {
+            return continuation;
+        }
+        return std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+template<typename T>
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    Outcome<T> outcome;
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+    void unhandled_exception() noexcept {
+        outcome.error = std::current_exception();
+    }
+
+    // Pistache promises are awaited directly, anything else goes as is.
+    template<typename U>
+    PromiseAwaiter<U> await_transform(Pistache::Async::Promise<U>&& promise) {
+        return PromiseAwaiter<U>(std::move(promise));
+    }
+    template<typename Awaitable>
+    Awaitable&& await_transform(Awaitable&& awaitable) const noexcept {
+        return std::forward<Awaitable>(awaitable);
+    }
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    Task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& value) {
+        this->outcome.value.emplace(std::forward<U>(value));
+    }
+};
+template<>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    Task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept {}
+};
+
+// Started right away and owns itself, frame is gone once it finishes.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept {
+            return {};
+        }
+        std::suspend_never initial_suspend() const noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() const noexcept {
+            return {};
+        }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept {
+            std::terminate();
+        }
+    };
+};
+
+}
+
+// Lazy coroutine, runs once awaited (or spawned) and resumes its awaiter when
+// done. Inside of it Pistache promises, eg. outbound client calls, are awaited
+// with co_await. Thread isn't held while waiting, so a single one can keep any
+// number of them in flight, but code after co_await runs on whichever thread
+// settled the promise and must not block it.
+template<typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    Task(Task&& other) noexcept : _handle(std::exchange(other._handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (_handle) {
+                _handle.destroy();
+            }
+            _handle = std::exchange(other._handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (_handle) {
+            _handle.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() {
+                return handle.promise().outcome.get();
+            }
+        };
+        return Awaiter{ _handle };
+    }
+
+private:
+    friend promise_type;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : _handle(handle) {}
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+template<typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+inline Task<void> detail::TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+// Runs task on the calling thread up to its first suspension, nobody awaits it.
+// As with std::thread, failure escaping it terminates, task handles its own.
+inline void spawn(Task<void> task) {
+    [](Task<void> task) -> detail::Detached {
+        co_await std::move(task);
+    }(std::move(task));
+}
+
+namespace detail {
+
+template<typename T>
+Detached settle(Task<T> task, Pistache::Async::Resolver resolve) {
+    Outcome<T> outcome;
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+        } else {
+            outcome.value.emplace(co_await std::move(task));
+        }
+    } catch (...) {
+        outcome.error = std::current_exception();
+    }
+    resolve(std::move(outcome));
+}
+
+}
+
+// Starts task and settles promise with its result, for code that chains with then(),
+// waits with waitFor() or starts several tasks and awaits them all afterwards.
+template<typename T>
+Pistache::Async::Promise<T> toPromise(Task<T> task) {
+    Pistache::Async::Promise<detail::Outcome<T>> settled(
+        [&task](Pistache::Async::Resolver& resolve, Pistache::Async::Rejection&) {
+            detail::settle(std::move(task), std::move(resolve));
+        }
+    );
+    // Rethrown failure rejects the returned promise with the original exception.
+    return settled.then([](detail::Outcome<T>& outcome) { return outcome.get(); }, Pistache::Async::Throw);
+}
+
+}
+
+#endif
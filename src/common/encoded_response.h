@@ -0,0 +1,117 @@
+#ifndef COMMON_ENCODED_RESPONSE_H
+#define COMMON_ENCODED_RESPONSE_H
+
+#include <string>
+#include <sstream>
+#include <optional>
+#include <stdexcept>
+
+#include <pistache/http.h>
+#include <pistache/http_headers.h>
+
+#include "compression.h"
+#include "expected.h"
+
+namespace common {
+
+// Value of a header whether pistache parsed it into a typed header or kept it raw.
+inline std::optional<std::string> headerValue(const Pistache::Http::Header::Collection& headers, const std::string& name) {
+    if (const auto raw = headers.tryGetRaw(name); raw.has_value()) {
+        return raw->value();
+    }
+    if (const auto typed = headers.tryGet(name); typed != nullptr) {
+        std::ostringstream value;
+        typed->write(value);
+        return value.str();
+    }
+    return std::nullopt;
+}
+
+inline Encoding acceptedEncoding(const Pistache::Http::Request& request) {
+    const auto accept_encoding = headerValue(request.headers(), "Accept-Encoding");
+    return accept_encoding.has_value() ? negotiate(*accept_encoding) : Encoding::Identity;
+}
+
+// Pistache's typed Content-Encoding has no zstd, this one carries any of ours.
+// Meant for outgoing requests, incoming ones are read with bodyEncoding().
+class ContentCoding : public Pistache::Http::Header::Header {
+public:
+    NAME("Content-Encoding")
+
+    ContentCoding() = default;
+    explicit ContentCoding(Encoding encoding) : _encoding(encoding) {}
+
+    void parse(const std::string& data) override {
+        _encoding = data == "gzip" ? Encoding::Gzip : data == "zstd" ? Encoding::Zstd : Encoding::Identity;
+    }
+    void write(std::ostream& stream) const override {
+        stream << common::name(_encoding);
+    }
+
+    Encoding encoding() const noexcept {
+        return _encoding;
+    }
+
+private:
+    Encoding _encoding{ Encoding::Identity };
+};
+
+// Encoding of a received body. Codings pistache doesn't know come through as
+// "unknown", the body's magic number tells them apart then.
+inline Encoding bodyEncoding(const Pistache::Http::Request& request) {
+    const auto content_encoding = headerValue(request.headers(), "Content-Encoding");
+    if (!content_encoding.has_value() || *content_encoding == "identity") {
+        return Encoding::Identity;
+    }
+    if (*content_encoding == "gzip") {
+        return Encoding::Gzip;
+    }
+    if (*content_encoding == "zstd") {
+        return Encoding::Zstd;
+    }
+    const auto& body = request.body();
+    if (body.size() >= 2 && body.compare(0, 2, "\x1f\x8b") == 0) {
+        return Encoding::Gzip;
+    }
+    if (body.size() >= 4 && body.compare(0, 4, "\x28\xb5\x2f\xfd") == 0) {
+        return Encoding::Zstd;
+    }
+    return Encoding::Identity;
+}
+
+// Body as sent, decompressed. Limited to max_size bytes after decompression,
+// usually the endpoint's limit on the body as received, a larger one is
+// refused as too large and one which doesn't decompress as a bad request.
+inline Expected<std::string> decodedBody(const Pistache::Http::Request& request, std::size_t max_size) {
+    const auto encoding = bodyEncoding(request);
+    if (encoding == Encoding::Identity) {
+        return request.body();
+    }
+    try {
+        return decompress(encoding, request.body(), max_size);
+    } catch (const BodyTooLarge& e) {
+        return Error{ Errc::PayloadTooLarge, e.what() };
+    } catch (const std::runtime_error& e) {
+        return Error{ Errc::BadRequest, e.what() };
+    }
+}
+
+// Sends body in the best encoding client accepts, compressing it only if it wasn't yet.
+inline void sendEncoded(
+    const Pistache::Http::Request& request,
+    Pistache::Http::ResponseWriter& response,
+    Pistache::Http::Code code,
+    const EncodedBody& body,
+    const Pistache::Http::Mime::MediaType& mime
+) {
+    const auto [encoding, data] = body.encode(acceptedEncoding(request));
+    response.headers().addRaw(Pistache::Http::Header::Raw("Vary", "Accept-Encoding"));
+    if (encoding != Encoding::Identity) {
+        response.headers().addRaw(Pistache::Http::Header::Raw("Content-Encoding", std::string(name(encoding))));
+    }
+    response.send(code, data, mime);
+}
+
+}
+
+#endif
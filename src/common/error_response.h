@@ -0,0 +1,86 @@
+#ifndef COMMON_ERROR_RESPONSE_H
+#define COMMON_ERROR_RESPONSE_H
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <optional>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <pistache/http.h>
+#include <pistache/router.h>
+#include <pistache/mime.h>
+
+#include "expected.h"
+#include "encoded_response.h"
+
+namespace common {
+
+inline Pistache::Http::Code status(Errc code) {
+    switch (code) {
+    case Errc::NotFound:             return Pistache::Http::Code::Not_Found;
+    case Errc::BadRequest:           return Pistache::Http::Code::Bad_Request;
+    case Errc::UnsupportedMediaType: return Pistache::Http::Code::Unsupported_Media_Type;
+    case Errc::PayloadTooLarge:      return Pistache::Http::Code::Payload_Too_Large;
+    case Errc::Gone:                 return Pistache::Http::Code::Gone;
+    }
+    return Pistache::Http::Code::Internal_Server_Error;
+}
+
+// Every expected failure is answered the same way, its status and a plain text reason.
+inline void sendError(Pistache::Http::ResponseWriter& response, const Error& error) {
+    response.send(status(error.code), error.message, MIME(Text, Plain));
+}
+
+// Numeric path parameter, eg. ":id". Anything else is a bad request, not an exception.
+inline Expected<std::size_t> idParam(const Pistache::Rest::Request& request, const std::string& name) {
+    const auto raw = request.param(name).as<std::string>();
+    std::size_t id = 0;
+    const auto [end, ec] = std::from_chars(raw.data(), raw.data() + raw.size(), id);
+    if (ec != std::errc{} || end != raw.data() + raw.size()) {
+        return Error{ Errc::BadRequest, "Id has to be a number" };
+    }
+    return id;
+}
+
+// Numeric query parameter, `fallback` when it's not there, or none at all if it's required.
+inline Expected<uint64_t> numberQuery(const Pistache::Rest::Request& request, const std::string& name,
+                                      std::optional<uint64_t> fallback = std::nullopt) {
+    const auto raw = request.query().get(name);
+    if (!raw.has_value()) {
+        if (fallback.has_value()) {
+            return *fallback;
+        }
+        return Error{ Errc::BadRequest, fmt::format("Missing {} parameter", name) };
+    }
+    uint64_t value = 0;
+    const auto [end, ec] = std::from_chars(raw->data(), raw->data() + raw->size(), value);
+    if (ec != std::errc{} || end != raw->data() + raw->size()) {
+        return Error{ Errc::BadRequest, fmt::format("Parameter {} has to be a number", name) };
+    }
+    return value;
+}
+
+// Body declared as something else than JSON is refused, no Content-Type passes as JSON.
+inline Expected<void> requireJson(const Pistache::Http::Request& request, std::string_view accepted = "application/json") {
+    if (const auto type = headerValue(request.headers(), "Content-Type");
+        type.has_value() && type->find("json") == std::string::npos) {
+        return Error{ Errc::UnsupportedMediaType, fmt::format("Wrong MIME type, only {} accepted, passed {}", accepted, *type) };
+    }
+    return {};
+}
+
+inline Expected<nlohmann::json> jsonBody(const Pistache::Http::Request& request) {
+    auto json = nlohmann::json::parse(request.body(), nullptr, false);
+    if (json.is_discarded()) {
+        return Error{ Errc::BadRequest, "Body isn't valid JSON" };
+    }
+    return json;
+}
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef COMMON_EXPECTED_H
+#define COMMON_EXPECTED_H
+
+#include <string>
+#include <variant>
+#include <optional>
+#include <utility>
+
+namespace common {
+
+// Failures a caller is expected to run into routinely, each maps to a client error status.
+enum class Errc {
+    NotFound,
+    BadRequest,
+    UnsupportedMediaType,
+    PayloadTooLarge,
+    Gone
+};
+
+struct Error {
+    Errc code;
+    // Constant and short on hot paths, misses then don't allocate.
+    std::string message;
+};
+
+// Value or the error which prevented it, returned instead of thrown so a miss
+// costs as much as a hit. Stand-in for std::expected until we're on C++23.
+template<typename T>
+class [[nodiscard]] Expected {
+public:
+    Expected(T value) : _result(std::in_place_index<0>, std::move(value)) {}
+    Expected(Error error) : _result(std::in_place_index<1>, std::move(error)) {}
+
+    bool has_value() const noexcept {
+        return _result.index() == 0;
+    }
+    explicit operator bool() const noexcept {
+        return has_value();
+    }
+
+    T& operator*() & {
+        return std::get<0>(_result);
+    }
+    const T& operator*() const& {
+        return std::get<0>(_result);
+    }
+    T&& operator*() && {
+        return std::get<0>(std::move(_result));
+    }
+    T* operator->() {
+        return &std::get<0>(_result);
+    }
+    const T* operator->() const {
+        return &std::get<0>(_result);
+    }
+
+    const Error& error() const& {
+        return std::get<1>(_result);
+    }
+    Error&& error() && {
+        return std::get<1>(std::move(_result));
+    }
+
+private:
+    std::variant<T, Error> _result;
+};
+
+template<>
+class [[nodiscard]] Expected<void> {
+public:
+    Expected() = default;
+    Expected(Error error) : _error(std::move(error)) {}
+
+    bool has_value() const noexcept {
+        return !_error.has_value();
+    }
+    explicit operator bool() const noexcept {
+        return has_value();
+    }
+
+    const Error& error() const& {
+        return *_error;
+    }
+    Error&& error() && {
+        return *std::move(_error);
+    }
+
+private:
+    std::optional<Error> _error;
+};
+
+}
+
+#endif
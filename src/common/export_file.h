@@ -0,0 +1,205 @@
+#ifndef COMMON_EXPORT_FILE_H
+#define COMMON_EXPORT_FILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <filesystem>
+#include <system_error>
+#include <cerrno>
+#include <cstdint>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "mvcc.h"
+
+namespace common {
+
+namespace detail {
+
+struct FileDescriptor {
+    int fd;
+
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    FileDescriptor(FileDescriptor&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+    FileDescriptor& operator=(FileDescriptor&&) = delete;
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+inline FileDescriptor openFile(const std::filesystem::path& path, int flags) {
+    FileDescriptor file(::open(path.c_str(), flags | O_CLOEXEC, 0644));
+    if (file.fd < 0) {
+        throw std::system_error(errno, std::generic_category(), fmt::format("Couldn't open {}", path.string()));
+    }
+    return file;
+}
+
+inline void writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const auto written = ::write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::system_error(errno, std::generic_category(), "Couldn't write export");
+        }
+        data.remove_prefix(static_cast<std::size_t>(written));
+    }
+}
+
+// Kernel side copy, shares extents on filesystems with reflinks. Falls back
+// to sendfile where copy_file_range can't cross filesystems or isn't there.
+inline void copyPrefix(int from, int to, uint64_t length) {
+    loff_t in = 0;
+    while (length > 0) {
+        const auto copied = ::copy_file_range(from, &in, to, nullptr, length, 0);
+        if (copied > 0) {
+            length -= static_cast<uint64_t>(copied);
+            continue;
+        }
+        if (copied < 0 && errno == EINTR) {
+            continue;
+        }
+        if (copied < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+            break;
+        }
+        throw std::system_error(copied < 0 ? errno : EIO, std::generic_category(), "Couldn't copy export");
+    }
+    off_t offset = static_cast<off_t>(in);
+    while (length > 0) {
+        const auto sent = ::sendfile(to, from, &offset, length);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            throw std::system_error(sent < 0 ? errno : EIO, std::generic_category(), "Couldn't copy export");
+        }
+        length -= static_cast<uint64_t>(sent);
+    }
+}
+
+}
+
+// Snapshot of an MvccVector pre-serialized on disk as a JSON array, for serving
+// with sendfile. Every version gets a file of its own, a file being served is
+// never rewritten. Only chunks changed since the previous file are serialized
+// again, the part before the first of them is copied over by the kernel.
+template<typename T>
+class ExportFile {
+public:
+    using Chunk = typename MvccVector<T>::Chunk;
+
+    // File of one version, removed once the last holder lets go of it. Holding
+    // it while opening the file is enough, open descriptors outlive removal.
+    struct Generation {
+        std::filesystem::path path;
+        uint64_t version = 0;
+        uint64_t size = 0;
+        // Chunks it was written from and offset of each one's first row, plus the end of rows.
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        std::vector<uint64_t> offsets;
+
+        Generation() = default;
+        Generation(const Generation&) = delete;
+        Generation& operator=(const Generation&) = delete;
+        ~Generation() {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+    };
+
+    static constexpr std::size_t write_size = 1024 * 1024;
+
+    // Leftovers of a previous run in directory are removed.
+    ExportFile(std::filesystem::path directory, std::string name)
+        : _directory(std::move(directory)),
+          _name(std::move(name)) {
+        std::filesystem::create_directories(_directory);
+        for (const auto& entry : std::filesystem::directory_iterator(_directory)) {
+            const auto file = entry.path().filename().string();
+            if (file.starts_with(_name + "-") && file.ends_with(".json")) {
+                std::error_code ec;
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    // File at least as new as snapshot, written first if there's none yet.
+    std::shared_ptr<const Generation> update(const typename MvccVector<T>::Snapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(_m);
+        if (_current && _current->version >= snapshot.version()) {
+            return _current;
+        }
+
+        auto next = std::make_shared<Generation>();
+        next->path = _directory / fmt::format("{}-{}.json", _name, snapshot.version());
+        next->version = snapshot.version();
+
+        const auto& chunks = snapshot.chunks();
+        std::size_t same = 0;
+        if (_current) {
+            while (same < chunks.size() && same < _current->chunks.size() && chunks[same] == _current->chunks[same]) {
+                ++same;
+            }
+        }
+
+        const auto out = detail::openFile(next->path, O_WRONLY | O_CREAT | O_TRUNC);
+        uint64_t offset = 0;
+        std::string buffer;
+        if (same > 0) {
+            offset = _current->offsets[same];
+            const auto in = detail::openFile(_current->path, O_RDONLY);
+            detail::copyPrefix(in.fd, out.fd, offset);
+            next->chunks.assign(chunks.begin(), chunks.begin() + static_cast<std::ptrdiff_t>(same));
+            next->offsets.assign(_current->offsets.begin(), _current->offsets.begin() + static_cast<std::ptrdiff_t>(same));
+        } else {
+            buffer += '[';
+        }
+
+        for (auto chunk = same; chunk < chunks.size(); ++chunk) {
+            next->chunks.push_back(chunks[chunk]);
+            next->offsets.push_back(offset + buffer.size());
+            for (const auto& row : *chunks[chunk]) {
+                // Chunks are never empty, the very first row is the first one of chunk 0.
+                if (chunk > 0 || &row != &chunks[chunk]->front()) {
+                    buffer += ',';
+                }
+                buffer += nlohmann::json(*row).dump();
+            }
+            if (buffer.size() >= write_size) {
+                detail::writeAll(out.fd, buffer);
+                offset += buffer.size();
+                buffer.clear();
+            }
+        }
+        next->offsets.push_back(offset + buffer.size());
+        buffer += ']';
+        detail::writeAll(out.fd, buffer);
+        next->size = offset + buffer.size();
+
+        _current = std::move(next);
+        return _current;
+    }
+
+private:
+    std::filesystem::path _directory;
+    std::string _name;
+    std::mutex _m;
+    std::shared_ptr<const Generation> _current;
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef COMMON_FILE_RESPONSE_H
+#define COMMON_FILE_RESPONSE_H
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <charconv>
+#include <system_error>
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include <pistache/http.h>
+#include <pistache/http_headers.h>
+#include <pistache/mime.h>
+
+#include "encoded_response.h"
+
+namespace common {
+
+// Longest part served for a single Range, longer ones are cut short and the
+// client asks for the rest (RFC 9110 lets the server send less).
+inline constexpr uint64_t max_range_bytes = 8 * 1024 * 1024;
+
+struct RangeRequest {
+    enum class Kind {
+        Whole,
+        Partial,
+        Unsatisfiable
+    };
+
+    Kind kind = Kind::Whole;
+    // Inclusive, as in Content-Range.
+    uint64_t first = 0;
+    uint64_t last = 0;
+};
+
+namespace detail {
+
+inline std::optional<uint64_t> parseOffset(std::string_view text) {
+    uint64_t value = 0;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || ec != std::errc{} || end != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+}
+
+// Single "bytes=" range of a file of `size` bytes. Anything we don't serve as
+// a part, several ranges or a header we can't read, gets the whole file.
+inline RangeRequest parseRange(const std::optional<std::string>& header, uint64_t size) {
+    constexpr std::string_view unit = "bytes=";
+    if (!header.has_value() || !header->starts_with(unit) || header->find(',') != std::string::npos) {
+        return {};
+    }
+    const auto spec = std::string_view(*header).substr(unit.size());
+    const auto dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return {};
+    }
+
+    if (dash == 0) {
+        const auto suffix = detail::parseOffset(spec.substr(1));
+        if (!suffix.has_value()) {
+            return {};
+        }
+        if (*suffix == 0 || size == 0) {
+            return { RangeRequest::Kind::Unsatisfiable };
+        }
+        return { RangeRequest::Kind::Partial, size - std::min(*suffix, size), size - 1 };
+    }
+
+    const auto first = detail::parseOffset(spec.substr(0, dash));
+    const auto last = dash + 1 == spec.size() ? std::optional<uint64_t>(UINT64_MAX) : detail::parseOffset(spec.substr(dash + 1));
+    if (!first.has_value() || !last.has_value() || *last < *first) {
+        return {};
+    }
+    if (*first >= size) {
+        return { RangeRequest::Kind::Unsatisfiable };
+    }
+    return { RangeRequest::Kind::Partial, *first, std::min(*last, size - 1) };
+}
+
+// Answers with the file at path, `size` bytes long and tagged with etag (quoted).
+// The whole file goes out with sendfile, a Range is answered with 206 and the
+// part read at its offset. An If-Range naming another tag gets the whole file.
+inline void sendFile(const Pistache::Http::Request& request,
+                     Pistache::Http::ResponseWriter& response,
+                     const std::string& path,
+                     uint64_t size,
+                     const Pistache::Http::Mime::MediaType& mime,
+                     const std::string& etag) {
+    response.headers()
+        .addRaw(Pistache::Http::Header::Raw("Accept-Ranges", "bytes"))
+        .addRaw(Pistache::Http::Header::Raw("ETag", etag));
+
+    auto range = parseRange(headerValue(request.headers(), "Range"), size);
+    if (const auto if_range = headerValue(request.headers(), "If-Range"); if_range.has_value() && *if_range != etag) {
+        range = {};
+    }
+
+    switch (range.kind) {
+    case RangeRequest::Kind::Whole:
+        Pistache::Http::serveFile(response, path, mime);
+        return;
+    case RangeRequest::Kind::Unsatisfiable:
+        response.headers().addRaw(Pistache::Http::Header::Raw("Content-Range", fmt::format("bytes */{}", size)));
+        response.send(Pistache::Http::Code::Requested_Range_Not_Satisfiable, "", MIME(Text, Plain));
+        return;
+    case RangeRequest::Kind::Partial:
+        break;
+    }
+
+    const auto last = std::min(range.last, range.first + max_range_bytes - 1);
+    std::string part(last - range.first + 1, '\0');
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), fmt::format("Couldn't open {}", path));
+    }
+    std::size_t read = 0;
+    while (read < part.size()) {
+        const auto got = ::pread(fd, part.data() + read, part.size() - read, static_cast<off_t>(range.first + read));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            const auto error = got < 0 ? errno : EIO;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), fmt::format("Couldn't read {}", path));
+        }
+        read += static_cast<std::size_t>(got);
+    }
+    ::close(fd);
+
+    response.headers().addRaw(Pistache::Http::Header::Raw(
+        "Content-Range", fmt::format("bytes {}-{}/{}", range.first, last, size)
+    ));
+    response.send(Pistache::Http::Code::Partial_Content, part, mime);
+}
+
+}
+
+#endif
@@ -0,0 +1,602 @@
+#ifndef COMMON_MVCC_H
+#define COMMON_MVCC_H
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <iterator>
+#include <numeric>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+#include <fmt/format.h>
+
+namespace common {
+
+// Epoch based reclamation. A reader pins the global epoch in one of the slots
+// for as long as it uses shared data, writers retire what they unlinked tagged
+// with the epoch it happened in and free it once every pinned epoch is newer.
+// Readers never wait for writers nor the other way around, they only touch
+// their own slot, no reference counts shared between cores.
+class EpochDomain {
+public:
+    static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+    static constexpr std::size_t slot_count = 128;
+
+    class Guard {
+    public:
+        Guard() = default;
+        explicit Guard(std::atomic<uint64_t>* slot) : _slot(slot) {}
+        Guard(EpochDomain* domain, std::list<uint64_t>::iterator overflow) : _domain(domain), _overflow(overflow) {}
+        Guard(Guard&& other) noexcept
+            : _slot(std::exchange(other._slot, nullptr)),
+              _domain(std::exchange(other._domain, nullptr)),
+              _overflow(other._overflow) {}
+        Guard& operator=(Guard&& other) noexcept {
+            release();
+            _slot = std::exchange(other._slot, nullptr);
+            _domain = std::exchange(other._domain, nullptr);
+            _overflow = other._overflow;
+            return *this;
+        }
+        ~Guard() {
+            release();
+        }
+
+    private:
+        void release() {
+            if (_slot) {
+                _slot->store(idle);
+            } else if (_domain) {
+                _domain->unpinOverflow(_overflow);
+            }
+        }
+
+        std::atomic<uint64_t>* _slot = nullptr;
+        // Pinned in the overflow list instead of a slot.
+        EpochDomain* _domain = nullptr;
+        std::list<uint64_t>::iterator _overflow;
+    };
+
+    EpochDomain() {
+        for (auto& slot : _slots) {
+            slot.epoch.store(idle);
+        }
+    }
+
+    // Slots are taken per pin, not per thread, so a reader may hold several.
+    // With every slot taken the pin goes to an overflow list under the lock
+    // writers retire with, slower but it never waits for a reader to finish.
+    Guard pin() {
+        for (auto& slot : _slots) {
+            auto expected = idle;
+            if (slot.epoch.load(std::memory_order_relaxed) == idle
+                && slot.epoch.compare_exchange_strong(expected, _epoch.load())) {
+                return Guard(&slot.epoch);
+            }
+        }
+        std::lock_guard<std::mutex> lock(_m);
+        _overflow.push_front(_epoch.load());
+        return Guard(this, _overflow.begin());
+    }
+
+    // Called once `retired` is no longer reachable by new readers.
+    void retire(std::shared_ptr<const void> retired) {
+        std::lock_guard<std::mutex> lock(_m);
+        const auto epoch = _epoch.fetch_add(1);
+        _retired.push_back({ epoch, std::move(retired) });
+        collect();
+    }
+
+    std::size_t pending() {
+        std::lock_guard<std::mutex> lock(_m);
+        return _retired.size();
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch;
+    };
+    struct Retired {
+        uint64_t epoch;
+        std::shared_ptr<const void> data;
+    };
+
+    void unpinOverflow(std::list<uint64_t>::iterator pinned) {
+        std::lock_guard<std::mutex> lock(_m);
+        _overflow.erase(pinned);
+    }
+
+    // Anything retired before the oldest pinned epoch can't be in use. Retired
+    // in epoch order, so only the front is looked at, a reader pinned for long
+    // doesn't make every write walk all that piled up behind it.
+    void collect() {
+        auto oldest = idle;
+        for (const auto& slot : _slots) {
+            oldest = std::min(oldest, slot.epoch.load());
+        }
+        for (const auto epoch : _overflow) {
+            oldest = std::min(oldest, epoch);
+        }
+        while (!_retired.empty() && _retired.front().epoch < oldest) {
+            _retired.pop_front();
+        }
+    }
+
+    std::atomic<uint64_t> _epoch{ 0 };
+    std::array<Slot, slot_count> _slots;
+    std::deque<Retired> _retired;
+    std::list<uint64_t> _overflow;
+    std::mutex _m;
+};
+
+// Vector with snapshot reads. Every write publishes a new immutable version,
+// a snapshot keeps seeing the version current when it was taken however long
+// it's held. Rows are immutable and shared between versions in chunks of
+// pointers, chunks are the leaves of a tree whose nodes are immutable too. A
+// write copies the row it changes, its chunk and the nodes on the path down to
+// it, O(log n) of them, everything else is shared with the previous version,
+// so a snapshot held for long pins little more than the rows written since.
+// Appends fill the last chunk, erase only shrinks the chunk holding the row.
+// Writers are serialized by an internal mutex, readers take no lock at all.
+template<typename T>
+class MvccVector {
+public:
+    static constexpr std::size_t chunk_size = 64;
+    // Children of a tree node.
+    static constexpr std::size_t fanout = 32;
+
+    using Row = std::shared_ptr<const T>;
+    using Chunk = std::vector<Row>;
+
+    // Rows and chunks under each child are kept alongside, lookups walk down
+    // by them. Nodes aren't merged when erases thin them out, only dropped
+    // once empty.
+    struct Node {
+        std::vector<std::size_t> rows;
+        std::vector<std::size_t> chunks;
+        // Children, chunks on the bottom level and nodes on the ones above.
+        std::vector<std::shared_ptr<const Node>> nodes;
+        std::vector<std::shared_ptr<const Chunk>> leaves;
+
+        std::size_t rowCount() const noexcept {
+            return std::accumulate(rows.begin(), rows.end(), std::size_t{ 0 });
+        }
+        std::size_t chunkCount() const noexcept {
+            return std::accumulate(chunks.begin(), chunks.end(), std::size_t{ 0 });
+        }
+    };
+
+    struct Version {
+        std::shared_ptr<const Node> root = std::make_shared<const Node>();
+        // Levels of nodes, the root's children are chunks with a single one.
+        std::size_t height = 1;
+        std::size_t size = 0;
+        std::size_t chunk_count = 0;
+        uint64_t number = 0;
+
+        // Chunk holding row and the row's index in it.
+        std::pair<const Chunk*, std::size_t> find(std::size_t row) const {
+            const Node* node = root.get();
+            for (auto level = height;; --level) {
+                std::size_t child = 0;
+                while (row >= node->rows[child]) {
+                    row -= node->rows[child++];
+                }
+                if (level == 1) {
+                    return { node->leaves[child].get(), row };
+                }
+                node = node->nodes[child].get();
+            }
+        }
+
+        const std::shared_ptr<const Chunk>& chunk(std::size_t index) const {
+            const Node* node = root.get();
+            for (auto level = height;; --level) {
+                std::size_t child = 0;
+                while (index >= node->chunks[child]) {
+                    index -= node->chunks[child++];
+                }
+                if (level == 1) {
+                    return node->leaves[child];
+                }
+                node = node->nodes[child].get();
+            }
+        }
+
+        const T& operator[](std::size_t row) const {
+            const auto [chunk, index] = find(row);
+            return *(*chunk)[index];
+        }
+    };
+
+    class Snapshot {
+    public:
+        // Walks chunk by chunk, finding the next one from the root, which
+        // amortized over its rows costs next to nothing.
+        class Iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T*;
+            using reference = const T&;
+
+            Iterator() = default;
+            Iterator(const Version* version, std::size_t chunk, std::size_t row)
+                : _version(version), _chunk(chunk), _row(row) {
+                load();
+            }
+
+            reference operator*() const {
+                return *(*_current)[_row];
+            }
+            pointer operator->() const {
+                return &**this;
+            }
+            Iterator& operator++() {
+                if (++_row == _current->size()) {
+                    ++_chunk;
+                    _row = 0;
+                    load();
+                }
+                return *this;
+            }
+            Iterator operator++(int) {
+                auto copy = *this;
+                ++*this;
+                return copy;
+            }
+            bool operator==(const Iterator& other) const {
+                return _chunk == other._chunk && _row == other._row;
+            }
+
+        private:
+            void load() {
+                _current = _version && _chunk < _version->chunk_count ? _version->chunk(_chunk).get() : nullptr;
+            }
+
+            const Version* _version = nullptr;
+            std::size_t _chunk = 0;
+            std::size_t _row = 0;
+            const Chunk* _current = nullptr;
+        };
+
+        Snapshot(EpochDomain::Guard guard, const Version* version)
+            : _guard(std::move(guard)), _version(version) {}
+
+        std::size_t size() const noexcept {
+            return _version->size;
+        }
+        bool empty() const noexcept {
+            return _version->size == 0;
+        }
+        // Version number, grows with every write.
+        uint64_t version() const noexcept {
+            return _version->number;
+        }
+
+        const T& operator[](std::size_t row) const {
+            return (*_version)[row];
+        }
+        const T& at(std::size_t row) const {
+            if (row >= size()) {
+                throw std::out_of_range(fmt::format("Row {} out of {}", row, size()));
+            }
+            return (*_version)[row];
+        }
+
+        // Chunks stay shared between versions until a write touches them, so data
+        // derived from a previous snapshot is only redone from its first changed chunk.
+        // Collected from the tree on every call.
+        std::vector<std::shared_ptr<const Chunk>> chunks() const {
+            std::vector<std::shared_ptr<const Chunk>> chunks;
+            chunks.reserve(_version->chunk_count);
+            collect(*_version->root, _version->height, chunks);
+            return chunks;
+        }
+
+        Iterator begin() const {
+            return { _version, 0, 0 };
+        }
+        Iterator end() const {
+            return { _version, _version->chunk_count, 0 };
+        }
+
+    private:
+        static void collect(const Node& node, std::size_t level, std::vector<std::shared_ptr<const Chunk>>& chunks) {
+            if (level == 1) {
+                chunks.insert(chunks.end(), node.leaves.begin(), node.leaves.end());
+                return;
+            }
+            for (const auto& child : node.nodes) {
+                collect(*child, level - 1, chunks);
+            }
+        }
+
+        EpochDomain::Guard _guard;
+        const Version* _version;
+    };
+
+    MvccVector(std::initializer_list<T> rows = {}) {
+        auto version = std::make_shared<Version>();
+        for (const auto& row : rows) {
+            append(*version, std::make_shared<const T>(row));
+        }
+        _owner = version;
+        _current.store(version.get());
+    }
+
+    MvccVector(const MvccVector&) = delete;
+    MvccVector& operator=(const MvccVector&) = delete;
+
+    // Pin first, then load: a version retired after the pin waits for it.
+    Snapshot snapshot() const {
+        auto guard = _epochs.pin();
+        return Snapshot(std::move(guard), _current.load());
+    }
+
+    // Latest version's size, number and rows, for writers checking or
+    // recording what they did. Read under the write lock, no epoch is pinned.
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(_write_m);
+        return _owner->size;
+    }
+    uint64_t version() const {
+        std::lock_guard<std::mutex> lock(_write_m);
+        return _owner->number;
+    }
+    Row latest(std::size_t row) const {
+        std::lock_guard<std::mutex> lock(_write_m);
+        if (row >= _owner->size) {
+            throw std::out_of_range(fmt::format("Row {} out of {}", row, _owner->size));
+        }
+        const auto [chunk, index] = _owner->find(row);
+        return (*chunk)[index];
+    }
+
+    std::size_t push_back(T row) {
+        return write([&](Version& version) {
+            append(version, std::make_shared<const T>(std::move(row)));
+            return version.size - 1;
+        });
+    }
+
+    // Rows show up all at once in a single version, returns index of the first one.
+    std::size_t append_range(std::vector<T> rows) {
+        return write([&](Version& version) {
+            const auto first = version.size;
+            auto row = rows.begin();
+            // Last chunk topped up first, the rest goes in whole chunks.
+            if (version.size > 0 && version.find(version.size - 1).first->size() < chunk_size) {
+                modify(version, version.size - 1, [&](const Chunk& chunk, std::size_t) {
+                    auto copy = std::make_shared<Chunk>(chunk);
+                    for (; row != rows.end() && copy->size() < chunk_size; ++row) {
+                        copy->push_back(std::make_shared<const T>(std::move(*row)));
+                    }
+                    return copy;
+                });
+            }
+            while (row != rows.end()) {
+                auto chunk = std::make_shared<Chunk>();
+                chunk->reserve(chunk_size);
+                for (; row != rows.end() && chunk->size() < chunk_size; ++row) {
+                    chunk->push_back(std::make_shared<const T>(std::move(*row)));
+                }
+                pushChunk(version, std::move(chunk));
+            }
+            return first;
+        });
+    }
+
+    void set(std::size_t row, T value) {
+        write([&](Version& version) {
+            replaceRow(version, row, std::make_shared<const T>(std::move(value)));
+            return 0;
+        });
+    }
+
+    // Applies f to a copy of the row, which replaces it in the new version.
+    template<typename F>
+    auto update(std::size_t row, F&& f) {
+        return write([&](Version& version) {
+            check(version, row);
+            const auto [chunk, index] = version.find(row);
+            auto copy = std::make_shared<T>(*(*chunk)[index]);
+            auto result = f(*copy);
+            replaceRow(version, row, std::move(copy));
+            return result;
+        });
+    }
+
+    void erase(std::size_t row) {
+        write([&](Version& version) {
+            check(version, row);
+            modify(version, row, [](const Chunk& chunk, std::size_t index) {
+                auto copy = std::make_shared<Chunk>(chunk);
+                copy->erase(copy->begin() + static_cast<std::ptrdiff_t>(index));
+                return copy->empty() ? nullptr : copy;
+            });
+            return 0;
+        });
+    }
+
+    // Versions retired but still possibly pinned by some reader.
+    std::size_t pendingVersions() {
+        return _epochs.pending();
+    }
+
+private:
+    static void check(const Version& version, std::size_t row) {
+        if (row >= version.size) {
+            throw std::out_of_range(fmt::format("Row {} out of {}", row, version.size));
+        }
+    }
+
+    static void replaceRow(Version& version, std::size_t row, Row value) {
+        check(version, row);
+        modify(version, row, [&](const Chunk& chunk, std::size_t index) {
+            auto copy = std::make_shared<Chunk>(chunk);
+            (*copy)[index] = std::move(value);
+            return copy;
+        });
+    }
+
+    // Replaces the chunk holding row with f(chunk, index of row in it), copying
+    // the nodes above it. A null chunk from f drops it, and nodes left empty.
+    template<typename F>
+    static void modify(Version& version, std::size_t row, F&& f) {
+        version.root = modify(*version.root, version.height, row, f);
+        // Root with a single child node is a level too many.
+        while (version.height > 1 && version.root->nodes.size() <= 1) {
+            if (version.root->nodes.empty()) {
+                version.root = std::make_shared<const Node>();
+                version.height = 1;
+            } else {
+                version.root = version.root->nodes.front();
+                --version.height;
+            }
+        }
+        version.size = version.root->rowCount();
+        version.chunk_count = version.root->chunkCount();
+    }
+
+    template<typename F>
+    static std::shared_ptr<const Node> modify(const Node& node, std::size_t level, std::size_t row, F& f) {
+        auto copy = std::make_shared<Node>(node);
+        std::size_t child = 0;
+        while (row >= copy->rows[child]) {
+            row -= copy->rows[child++];
+        }
+        std::size_t rows = 0;
+        std::size_t chunks = 0;
+        if (level == 1) {
+            std::shared_ptr<const Chunk> chunk = f(*copy->leaves[child], row);
+            if (chunk) {
+                rows = chunk->size();
+                chunks = 1;
+                copy->leaves[child] = std::move(chunk);
+            } else {
+                copy->leaves.erase(copy->leaves.begin() + static_cast<std::ptrdiff_t>(child));
+            }
+        } else {
+            auto next = modify(*copy->nodes[child], level - 1, row, f);
+            rows = next->rowCount();
+            chunks = next->chunkCount();
+            if (chunks > 0) {
+                copy->nodes[child] = std::move(next);
+            } else {
+                copy->nodes.erase(copy->nodes.begin() + static_cast<std::ptrdiff_t>(child));
+            }
+        }
+        if (chunks > 0) {
+            copy->rows[child] = rows;
+            copy->chunks[child] = chunks;
+        } else {
+            copy->rows.erase(copy->rows.begin() + static_cast<std::ptrdiff_t>(child));
+            copy->chunks.erase(copy->chunks.begin() + static_cast<std::ptrdiff_t>(child));
+        }
+        return copy;
+    }
+
+    // New last chunk. A full node on the way splits off a sibling holding just
+    // the new child, a full root gets a parent.
+    static void pushChunk(Version& version, std::shared_ptr<const Chunk> chunk) {
+        const auto rows = chunk->size();
+        auto [root, sibling] = pushChunk(version.root, version.height, std::move(chunk));
+        if (sibling) {
+            auto parent = std::make_shared<Node>();
+            for (auto* child : { &root, &sibling }) {
+                parent->rows.push_back((*child)->rowCount());
+                parent->chunks.push_back((*child)->chunkCount());
+                parent->nodes.push_back(std::move(*child));
+            }
+            root = std::move(parent);
+            ++version.height;
+        }
+        version.root = std::move(root);
+        version.size += rows;
+        ++version.chunk_count;
+    }
+
+    static std::pair<std::shared_ptr<const Node>, std::shared_ptr<const Node>> pushChunk(
+        const std::shared_ptr<const Node>& node, std::size_t level, std::shared_ptr<const Chunk> chunk
+    ) {
+        auto copy = std::make_shared<Node>(*node);
+        std::shared_ptr<Node> sibling;
+        // Where the new child goes, this node unless it's full.
+        const auto target = [&](std::size_t children) -> Node& {
+            if (children < fanout) {
+                return *copy;
+            }
+            sibling = std::make_shared<Node>();
+            return *sibling;
+        };
+        if (level == 1) {
+            auto& parent = target(copy->leaves.size());
+            parent.rows.push_back(chunk->size());
+            parent.chunks.push_back(1);
+            parent.leaves.push_back(std::move(chunk));
+        } else {
+            auto [child, split] = pushChunk(node->nodes.back(), level - 1, std::move(chunk));
+            copy->rows.back() = child->rowCount();
+            copy->chunks.back() = child->chunkCount();
+            copy->nodes.back() = std::move(child);
+            if (!split) {
+                return { std::move(copy), nullptr };
+            }
+            auto& parent = target(copy->nodes.size());
+            parent.rows.push_back(split->rowCount());
+            parent.chunks.push_back(split->chunkCount());
+            parent.nodes.push_back(std::move(split));
+        }
+        return { std::move(copy), std::move(sibling) };
+    }
+
+    // Into the last chunk while it has room, a new one otherwise.
+    static void append(Version& version, Row row) {
+        if (version.size > 0 && version.find(version.size - 1).first->size() < chunk_size) {
+            modify(version, version.size - 1, [&](const Chunk& chunk, std::size_t) {
+                auto copy = std::make_shared<Chunk>(chunk);
+                copy->push_back(std::move(row));
+                return copy;
+            });
+            return;
+        }
+        auto chunk = std::make_shared<Chunk>();
+        chunk->reserve(chunk_size);
+        chunk->push_back(std::move(row));
+        pushChunk(version, std::move(chunk));
+    }
+
+    // Next version starts as a copy of the current one's root, the write
+    // copies whatever it changes below it.
+    template<typename F>
+    auto write(F&& f) {
+        std::lock_guard<std::mutex> lock(_write_m);
+        auto next = std::make_shared<Version>(*_owner);
+        ++next->number;
+        auto result = f(*next);
+        auto previous = std::exchange(_owner, next);
+        _current.store(next.get());
+        _epochs.retire(std::move(previous));
+        return result;
+    }
+
+    mutable EpochDomain _epochs;
+    std::atomic<const Version*> _current{ nullptr };
+    // Keeps the current version alive, retired ones are kept by _epochs.
+    std::shared_ptr<const Version> _owner;
+    mutable std::mutex _write_m;
+};
+
+}
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef COMMON_NDJSON_H
+#define COMMON_NDJSON_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <thread>
+#include <latch>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <optional>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <pistache/http.h>
+#include <pistache/mime.h>
+#include <pistache/peer.h>
+#include <pistache/stream.h>
+
+#include "expected.h"
+#include "worker_pool.h"
+
+namespace common {
+
+// Smallest slice of a body worth a thread of its own.
+inline constexpr std::size_t ndjson_min_part = 256 * 1024;
+
+// Cuts body into at most `parts` slices of about equal length, each ending
+// right after a newline (the last one at the end of body).
+inline std::vector<std::string_view> splitLines(std::string_view body, std::size_t parts) {
+    std::vector<std::string_view> slices;
+    parts = std::max<std::size_t>(parts, 1);
+    std::size_t begin = 0;
+    for (std::size_t part = 1; part <= parts && begin < body.size(); ++part) {
+        auto end = part == parts ? body.size() : std::max(begin, body.size() * part / parts);
+        if (end < body.size()) {
+            const auto newline = body.find('\n', end);
+            end = newline == std::string_view::npos ? body.size() : newline + 1;
+        }
+        slices.push_back(body.substr(begin, end - begin));
+        begin = end;
+    }
+    return slices;
+}
+
+namespace detail {
+
+template<typename T>
+struct NdjsonPart {
+    std::vector<T> values;
+    std::size_t lines = 0;
+    // Line within the part (from 1) and why it didn't parse.
+    std::optional<std::pair<std::size_t, std::string>> error;
+};
+
+template<typename T>
+void parseNdjsonPart(std::string_view slice, NdjsonPart<T>& part) {
+    std::size_t begin = 0;
+    while (begin < slice.size()) {
+        const auto newline = slice.find('\n', begin);
+        const auto end = newline == std::string_view::npos ? slice.size() : newline;
+        auto line = slice.substr(begin, end - begin);
+        begin = end + 1;
+        ++part.lines;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.find_first_not_of(" \t") == std::string_view::npos) {
+            continue;
+        }
+        try {
+            part.values.push_back(nlohmann::json::parse(line).template get<T>());
+        } catch (const std::exception& e) {
+            part.error.emplace(part.lines, e.what());
+            return;
+        }
+    }
+}
+
+}
+
+// Newline-delimited JSON, one T per line, blank lines skipped. Large bodies are
+// split on line boundaries and parsed on up to `threads` threads at once, the
+// caller's and those of WorkerPool::shared(), values
+// come back in the order of lines. Nothing is returned if any line is malformed,
+// the error names the first such line.
+template<typename T>
+Expected<std::vector<T>> parseNdjson(std::string_view body, unsigned threads = std::thread::hardware_concurrency()) {
+    const auto parts = std::clamp<std::size_t>(body.size() / ndjson_min_part, 1, std::max(threads, 1U));
+    const auto slices = splitLines(body, parts);
+    std::vector<detail::NdjsonPart<T>> parsed(slices.size());
+    // First slice is parsed right here, the others by the shared pool meanwhile.
+    std::latch done(static_cast<std::ptrdiff_t>(slices.size() - 1));
+    for (std::size_t i = 1; i < slices.size(); ++i) {
+        WorkerPool::shared().submit([&, i] {
+            detail::parseNdjsonPart(slices[i], parsed[i]);
+            done.count_down();
+        });
+    }
+    detail::parseNdjsonPart(slices.front(), parsed.front());
+    done.wait();
+
+    std::size_t lines = 0;
+    std::size_t count = 0;
+    for (const auto& part : parsed) {
+        if (part.error.has_value()) {
+            return Error{ Errc::BadRequest, fmt::format("Line {}: {}", lines + part.error->first, part.error->second) };
+        }
+        lines += part.lines;
+        count += part.values.size();
+    }
+    std::vector<T> values;
+    values.reserve(count);
+    for (auto& part : parsed) {
+        std::move(part.values.begin(), part.values.end(), std::back_inserter(values));
+    }
+    return values;
+}
+
+// Appends value as a single NDJSON line.
+template<typename T>
+void appendNdjson(std::string& out, const T& value) {
+    out += nlohmann::json(value).dump();
+    out += '\n';
+}
+
+// Bytes serialized before they're handed to the connection as one chunk.
+inline constexpr std::size_t ndjson_chunk = 64 * 1024;
+
+namespace detail {
+
+// Export in progress, kept alive by the write in flight.
+template<typename Range>
+struct NdjsonStream {
+    Range values;
+    decltype(std::begin(std::declval<const Range&>())) next;
+    decltype(std::end(std::declval<const Range&>())) end;
+    std::shared_ptr<Pistache::Tcp::Peer> peer;
+    // Set while a chunk is being handed over, tells whether it was written at once.
+    std::atomic<bool> sending{ false };
+
+    NdjsonStream(Range range, std::shared_ptr<Pistache::Tcp::Peer> to)
+        : values(std::move(range)),
+          next(std::begin(std::as_const(values))),
+          end(std::end(std::as_const(values))),
+          peer(std::move(to)) {}
+};
+
+// Sends chunks while writes complete right away. One which doesn't continues
+// from its completion, so there's never more than a chunk waiting for the client.
+template<typename Range>
+void sendNdjsonChunks(const std::shared_ptr<NdjsonStream<Range>>& state) {
+    for (;;) {
+        std::string chunk;
+        chunk.reserve(ndjson_chunk + ndjson_chunk / 4);
+        while (state->next != state->end && chunk.size() < ndjson_chunk) {
+            appendNdjson(chunk, *state->next);
+            ++state->next;
+        }
+        const bool last = state->next == state->end;
+        auto framed = chunk.empty() ? std::string() : fmt::format("{:x}\r\n{}\r\n", chunk.size(), chunk);
+        if (last) {
+            framed += "0\r\n\r\n";
+        }
+
+        const auto size = framed.size();
+        state->sending.store(true);
+        state->peer->send(Pistache::RawBuffer(std::move(framed), size)).then(
+            [state, last](ssize_t) {
+                // Written before send() returned, the loop goes on with the next one.
+                if (last || state->sending.exchange(false)) {
+                    return;
+                }
+                sendNdjsonChunks(state);
+            },
+            // Client went away, the snapshot is let go of together with state.
+            Pistache::Async::IgnoreException
+        );
+        if (last || state->sending.exchange(false)) {
+            return;
+        }
+    }
+}
+
+}
+
+// Streams every value of range as NDJSON with chunked transfer encoding. A
+// chunk is serialized only once the previous one got to the client, never the
+// whole range, and a slow client holds up only its own export. The range, eg.
+// a snapshot, is kept until the last chunk is written or the client is gone.
+template<typename Range>
+void streamNdjson(Pistache::Http::ResponseWriter& response, Range values) {
+    response.headers().add<Pistache::Http::Header::ContentType>(
+        Pistache::Http::Mime::MediaType::fromString("application/x-ndjson")
+    );
+    auto peer = response.peer();
+    // Status line and headers go out first, chunks are written to the peer
+    // itself as a stream doesn't tell when a flush got through.
+    auto stream = response.stream(Pistache::Http::Code::Ok);
+    stream.flush();
+    detail::sendNdjsonChunks(std::make_shared<detail::NdjsonStream<Range>>(std::move(values), std::move(peer)));
+}
+
+}
+
+#endif
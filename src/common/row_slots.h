@@ -0,0 +1,114 @@
+#ifndef COMMON_ROW_SLOTS_H
+#define COMMON_ROW_SLOTS_H
+
+#include <vector>
+#include <bit>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+namespace common {
+
+// Positions of a store's rows, which shift when an earlier row is erased, on
+// slots which don't: every appended row takes the next slot, an erased one
+// leaves a tombstone. Indexes keep slots, so an erase costs them O(log n)
+// instead of renumbering everything after it. Live slots are counted in a
+// Fenwick tree, position -> slot and back are O(log n) too. compact() drops
+// the tombstones once they pile up.
+// Not synchronized, it's guarded together with the store it mirrors.
+class RowSlots {
+public:
+    static constexpr uint32_t erased = std::numeric_limits<uint32_t>::max();
+
+    // Live rows.
+    std::size_t size() const noexcept {
+        return _live_count;
+    }
+
+    std::size_t tombstones() const noexcept {
+        return _live.size() - _live_count;
+    }
+
+    // Slot of a row appended after all others.
+    uint32_t append() {
+        const auto slot = static_cast<uint32_t>(_live.size());
+        _live.push_back(true);
+        // Node i counts (i - lowbit(i), i], of which all but the new slot are in place already.
+        const auto node = _live.size();
+        _tree.push_back(1 + prefix(node - 1) - prefix(node - (node & -node)));
+        ++_live_count;
+        return slot;
+    }
+
+    uint32_t slot(std::size_t position) const {
+        if (position >= _live_count) {
+            throw std::out_of_range("RowSlots::slot");
+        }
+        std::size_t node = 0;
+        for (auto step = std::bit_floor(_live.size()); step > 0; step >>= 1) {
+            if (node + step <= _live.size() && _tree[node + step] <= position) {
+                node += step;
+                position -= _tree[node];
+            }
+        }
+        return static_cast<uint32_t>(node);
+    }
+
+    // Live rows before slot.
+    std::size_t position(uint32_t slot) const {
+        return prefix(slot);
+    }
+
+    bool live(uint32_t slot) const {
+        return slot < _live.size() && _live[slot];
+    }
+
+    void erase(uint32_t slot) {
+        if (!live(slot)) {
+            throw std::out_of_range("RowSlots::erase");
+        }
+        _live[slot] = false;
+        --_live_count;
+        for (auto node = static_cast<std::size_t>(slot) + 1; node < _tree.size(); node += node & -node) {
+            --_tree[node];
+        }
+    }
+
+    // Live slots numbered anew in the same order, returns old slot -> new one,
+    // `erased` for tombstones.
+    std::vector<uint32_t> compact() {
+        std::vector<uint32_t> renamed(_live.size(), erased);
+        uint32_t next = 0;
+        for (uint32_t slot = 0; slot < _live.size(); ++slot) {
+            if (_live[slot]) {
+                renamed[slot] = next++;
+            }
+        }
+        _live.assign(_live_count, true);
+        // Every node counts its whole range.
+        _tree.resize(_live_count + 1);
+        for (std::size_t node = 1; node < _tree.size(); ++node) {
+            _tree[node] = static_cast<uint32_t>(node & -node);
+        }
+        return renamed;
+    }
+
+private:
+    // Live slots among the first count ones.
+    std::size_t prefix(std::size_t count) const {
+        std::size_t sum = 0;
+        for (auto node = count; node > 0; node &= node - 1) {
+            sum += _tree[node];
+        }
+        return sum;
+    }
+
+    std::vector<bool> _live;
+    // 1-based, node i counts live slots in (i - lowbit(i), i].
+    std::vector<uint32_t> _tree{ 0 };
+    std::size_t _live_count = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef COMMON_SEARCH_INDEX_H
+#define COMMON_SEARCH_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include "row_slots.h"
+
+namespace common {
+
+namespace detail {
+
+// Code point at i, advancing i. Malformed bytes are taken as Latin-1.
+inline char32_t decodeUtf8(std::string_view text, std::size_t& i) {
+    const auto byte = static_cast<unsigned char>(text[i++]);
+    int extra = byte >= 0xF0 ? 3 : byte >= 0xE0 ? 2 : byte >= 0xC0 ? 1 : 0;
+    if (extra == 0 || i + extra > text.size()) {
+        return byte;
+    }
+    char32_t cp = byte & (0x3F >> extra);
+    for (int k = 0; k < extra; ++k) {
+        const auto next = static_cast<unsigned char>(text[i + k]);
+        if ((next & 0xC0) != 0x80) {
+            return byte;
+        }
+        cp = (cp << 6) | (next & 0x3F);
+    }
+    i += extra;
+    return cp;
+}
+
+inline void encodeUtf8(char32_t cp, std::string& out) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Latin-1 and Latin Extended-A, which covers Polish ("Ą Ć Ę Ł Ń Ó Ś Ź Ż").
+inline char32_t caseFold(char32_t cp) {
+    if (cp >= 'A' && cp <= 'Z') {
+        return cp + 0x20;
+    }
+    if (cp >= 0xC0 && cp <= 0xDE && cp != 0xD7) {
+        return cp + 0x20;
+    }
+    if ((cp >= 0x100 && cp <= 0x137) || (cp >= 0x14A && cp <= 0x177)) {
+        return cp | 1;
+    }
+    if ((cp >= 0x139 && cp <= 0x148) || (cp >= 0x179 && cp <= 0x17E)) {
+        return cp % 2 == 1 ? cp + 1 : cp;
+    }
+    return cp;
+}
+
+inline bool isWordChar(char32_t cp) {
+    if (cp < 0x80) {
+        return (cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z');
+    }
+    // Latin-1 punctuation and symbols, general punctuation block.
+    if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7 || (cp >= 0x2000 && cp <= 0x206F)) {
+        return false;
+    }
+    return true;
+}
+
+inline void putVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline uint32_t getVarint(std::string_view in, std::size_t& i) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const auto byte = static_cast<unsigned char>(in[i++]);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+}
+
+// Case folded words of a UTF-8 text.
+inline std::vector<std::string> tokenize(std::string_view text) {
+    std::vector<std::string> tokens;
+    std::string token;
+    std::size_t i = 0;
+    while (i < text.size()) {
+        const auto cp = detail::decodeUtf8(text, i);
+        if (detail::isWordChar(cp)) {
+            detail::encodeUtf8(detail::caseFold(cp), token);
+        } else if (!token.empty()) {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    }
+    if (!token.empty()) {
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+// Inverted index over documents addressed by their position in the store,
+// which shifts when an earlier document is erased, so positions go through
+// RowSlots and an erase doesn't renumber what's after it. Internally a document
+// is one or more parts, what it was added with and whatever extended it later,
+// each with an id growing with every insert, so posting lists are only ever
+// appended to and stay sorted: delta-encoded (part id, term frequency) varint
+// pairs. A query sums a document's frequencies over its parts before ranking.
+// Erased parts are skipped until tombstones outnumber live parts, then lists
+// are rewritten without them and ids renumbered. Ranked with BM25.
+// Not synchronized, it's guarded together with the store it indexes.
+class SearchIndex {
+public:
+    struct Field {
+        std::string_view text;
+        // Every occurrence counts this many times, eg. titles over comments.
+        uint32_t weight = 1;
+    };
+    struct Hit {
+        std::size_t position;
+        double score;
+    };
+
+    void append(const std::vector<Field>& fields) {
+        const auto slot = _rows.append();
+        _lengths.push_back(0);
+        _documents.push_back(add(fields, slot, no_part));
+    }
+
+    void replace(std::size_t position, const std::vector<Field>& fields) {
+        const auto slot = _rows.slot(position);
+        remove(slot);
+        _documents[slot] = add(fields, slot, no_part);
+        compactIfNeeded();
+    }
+
+    // More fields of the document at position, eg. a comment appended to a
+    // message. Only they are tokenized, what's indexed already stays as it is.
+    void extend(std::size_t position, const std::vector<Field>& fields) {
+        const auto slot = _rows.slot(position);
+        _documents[slot] = add(fields, slot, _documents[slot]);
+    }
+
+    void erase(std::size_t position) {
+        const auto slot = _rows.slot(position);
+        remove(slot);
+        _rows.erase(slot);
+        compactIfNeeded();
+    }
+
+    // Documents containing any of the query's words, best first.
+    std::vector<Hit> search(std::string_view query, std::size_t limit) const {
+        constexpr double k1 = 1.2;
+        constexpr double b = 0.75;
+
+        const auto live = static_cast<double>(_rows.size());
+        const double average_length = live == 0 ? 1 : std::max(1.0, static_cast<double>(_total_length) / live);
+
+        // By slot.
+        std::unordered_map<uint32_t, double> scores;
+        std::unordered_map<uint32_t, uint32_t> frequencies;
+        auto terms = tokenize(query);
+        std::sort(terms.begin(), terms.end());
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        for (const auto& term : terms) {
+            const auto it = _postings.find(term);
+            if (it == _postings.end()) {
+                continue;
+            }
+            frequencies.clear();
+            forEachPosting(it->second, [&](uint32_t part, uint32_t tf) {
+                frequencies[_slots[part]] += tf;
+            });
+            const auto df = static_cast<double>(frequencies.size());
+            const double idf = std::log(1 + (live - df + 0.5) / (df + 0.5));
+            for (const auto& [slot, tf] : frequencies) {
+                const auto length = static_cast<double>(_lengths[slot]);
+                const auto frequency = static_cast<double>(tf);
+                scores[slot] += idf * frequency * (k1 + 1) / (frequency + k1 * (1 - b + b * length / average_length));
+            }
+        }
+
+        std::vector<Hit> hits;
+        hits.reserve(scores.size());
+        for (const auto& [slot, score] : scores) {
+            hits.push_back({ _rows.position(slot), score });
+        }
+        const auto by_score = [](const Hit& l, const Hit& r) {
+            return l.score != r.score ? l.score > r.score : l.position < r.position;
+        };
+        if (hits.size() > limit) {
+            std::partial_sort(hits.begin(), hits.begin() + static_cast<std::ptrdiff_t>(limit), hits.end(), by_score);
+            hits.resize(limit);
+        } else {
+            std::sort(hits.begin(), hits.end(), by_score);
+        }
+        return hits;
+    }
+
+private:
+    // Previous part of a document's first one.
+    static constexpr uint32_t no_part = std::numeric_limits<uint32_t>::max();
+
+    struct PostingList {
+        std::string bytes;
+        uint32_t last_part = 0;
+        // Parts listed, erased ones included until compaction.
+        uint32_t parts = 0;
+    };
+
+    template<typename F>
+    void forEachPosting(const PostingList& list, F&& f) const {
+        std::size_t i = 0;
+        uint32_t part = 0;
+        while (i < list.bytes.size()) {
+            part += detail::getVarint(list.bytes, i);
+            const auto tf = detail::getVarint(list.bytes, i);
+            if (_slots[part] != RowSlots::erased) {
+                f(part, tf);
+            }
+        }
+    }
+
+    static void appendPosting(PostingList& list, uint32_t part, uint32_t tf) {
+        detail::putVarint(list.bytes, list.bytes.empty() ? part : part - list.last_part);
+        detail::putVarint(list.bytes, tf);
+        list.last_part = part;
+        ++list.parts;
+    }
+
+    uint32_t add(const std::vector<Field>& fields, uint32_t slot, uint32_t previous) {
+        const auto part = static_cast<uint32_t>(_slots.size());
+        std::unordered_map<std::string, uint32_t> frequencies;
+        uint32_t length = 0;
+        for (const auto& field : fields) {
+            for (auto& token : tokenize(field.text)) {
+                frequencies[std::move(token)] += field.weight;
+                length += field.weight;
+            }
+        }
+        for (const auto& [term, tf] : frequencies) {
+            appendPosting(_postings[term], part, tf);
+        }
+        _slots.push_back(slot);
+        _previous.push_back(previous);
+        _lengths[slot] += length;
+        _total_length += length;
+        return part;
+    }
+
+    // Postings stay until compaction, only the document's parts are marked.
+    void remove(uint32_t slot) {
+        for (auto part = _documents[slot]; part != no_part; part = _previous[part]) {
+            _slots[part] = RowSlots::erased;
+            ++_tombstones;
+        }
+        _total_length -= _lengths[slot];
+        _lengths[slot] = 0;
+    }
+
+    void compactIfNeeded() {
+        if (_tombstones > 64 && _tombstones > _slots.size() - _tombstones) {
+            compact();
+        }
+    }
+
+    // Live parts get ids anew, in the order of their old ones, so posting
+    // lists stay sorted and the per part vectors shrink to what's live.
+    // Slots of erased rows go too.
+    void compact() {
+        const auto renamed_slots = _rows.compact();
+        std::vector<uint32_t> renamed(_slots.size(), no_part);
+        std::vector<uint32_t> slots;
+        std::vector<uint32_t> previous;
+        slots.reserve(_slots.size() - _tombstones);
+        previous.reserve(_slots.size() - _tombstones);
+        for (uint32_t part = 0; part < _slots.size(); ++part) {
+            if (_slots[part] != RowSlots::erased) {
+                renamed[part] = static_cast<uint32_t>(slots.size());
+                slots.push_back(renamed_slots[_slots[part]]);
+                // Earlier and live, parts of a document are erased together.
+                previous.push_back(_previous[part] == no_part ? no_part : renamed[_previous[part]]);
+            }
+        }
+
+        for (auto it = _postings.begin(); it != _postings.end();) {
+            PostingList compacted;
+            forEachPosting(it->second, [&](uint32_t part, uint32_t tf) {
+                appendPosting(compacted, renamed[part], tf);
+            });
+            if (compacted.parts == 0) {
+                it = _postings.erase(it);
+            } else {
+                compacted.bytes.shrink_to_fit();
+                it->second = std::move(compacted);
+                ++it;
+            }
+        }
+        std::vector<uint32_t> documents(_rows.size());
+        std::vector<uint32_t> lengths(_rows.size());
+        for (uint32_t slot = 0; slot < renamed_slots.size(); ++slot) {
+            if (renamed_slots[slot] != RowSlots::erased) {
+                documents[renamed_slots[slot]] = renamed[_documents[slot]];
+                lengths[renamed_slots[slot]] = _lengths[slot];
+            }
+        }
+        _documents = std::move(documents);
+        _lengths = std::move(lengths);
+        _slots = std::move(slots);
+        _previous = std::move(previous);
+        _tombstones = 0;
+    }
+
+    std::unordered_map<std::string, PostingList> _postings;
+    RowSlots _rows;
+    // By slot: last part of the document and its length over all parts.
+    std::vector<uint32_t> _documents;
+    std::vector<uint32_t> _lengths;
+    // By part id.
+    std::vector<uint32_t> _slots;
+    std::vector<uint32_t> _previous;
+    uint64_t _total_length = 0;
+    std::size_t _tombstones = 0;
+};
+
+}
+
+#endif
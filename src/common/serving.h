@@ -0,0 +1,224 @@
+#ifndef COMMON_SERVING_H
+#define COMMON_SERVING_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <spdlog/spdlog.h>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <CLI/CLI.hpp>
+
+#include <pistache/endpoint.h>
+
+#include "admission.h"
+
+namespace common {
+
+// How a service spreads over cores. Every listener is a separate endpoint bound
+// to the same port with SO_REUSEPORT, so the kernel balances connections between
+// them, with its own reactor threads. All of them share one process, and so
+// one in-memory store.
+struct ServingOptions {
+    uint listeners = 1;
+    uint threads = 1;
+    // Reactor threads of a listener stay on its own cores.
+    bool pin = false;
+    // Listener's cores come from a single NUMA node and its threads allocate
+    // node-locally, so per-connection buffers live next to the cores using them.
+    bool numa = false;
+    // Whole body is buffered before the handler runs, bulk imports come as a single one.
+    std::size_t max_request_bytes = 16 * 1024 * 1024;
+    // Shared by all listeners, a client's rate is the same whichever one it's on.
+    AdmissionOptions admission;
+};
+
+inline void addServingOptions(CLI::App& app, ServingOptions& options) {
+    app.add_option("--listeners", options.listeners, "SO_REUSEPORT listeners on the same port, eg. one per core.");
+    app.add_option("--threads", options.threads, "Reactor threads per listener.");
+    app.add_flag("--pin", options.pin, "Pin every listener's threads to its own cores.");
+    app.add_flag("--numa", options.numa, "Keep every listener on a single NUMA node, implies --pin.");
+    app.add_option("--max-request-bytes", options.max_request_bytes, "Largest request body accepted, eg. of a bulk import.");
+    addAdmissionOptions(app, options.admission);
+}
+
+// "0-3,8,10-11" as in sysfs.
+inline std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::size_t begin = 0;
+    while (begin < list.size()) {
+        const auto end = std::min(list.find(',', begin), list.size());
+        const auto range = list.substr(begin, end - begin);
+        begin = end + 1;
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        const auto dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+// CPUs this process may run on grouped by NUMA node, one group without NUMA information.
+inline std::vector<std::vector<int>> cpuNodes() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    std::vector<std::vector<int>> nodes;
+    std::error_code ec;
+    for (int node = 0; std::filesystem::exists(fmt::format("/sys/devices/system/node/node{}", node), ec); ++node) {
+        std::ifstream file(fmt::format("/sys/devices/system/node/node{}/cpulist", node));
+        std::string list;
+        std::getline(file, list);
+        auto cpus = parseCpuList(list);
+        std::erase_if(cpus, [&](int cpu) { return !CPU_ISSET(cpu, &allowed); });
+        if (!cpus.empty()) {
+            nodes.push_back(std::move(cpus));
+        }
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                nodes.back().push_back(cpu);
+            }
+        }
+    }
+    return nodes;
+}
+
+// Set of endpoints serving one handler, see ServingOptions.
+class Endpoints {
+public:
+    Endpoints(Pistache::Address address, ServingOptions options)
+        : _options(options) {
+        _options.listeners = std::max(_options.listeners, 1U);
+        _options.threads = std::max(_options.threads, 1U);
+        _options.pin = _options.pin || _options.numa;
+        for (uint i = 0; i < _options.listeners; ++i) {
+            _end_points.push_back(std::make_shared<Pistache::Http::Endpoint>(address));
+        }
+    }
+
+    const ServingOptions& options() const noexcept {
+        return _options;
+    }
+
+    // Thread count, request size and socket flags come from ServingOptions, rest from given options.
+    void init(Pistache::Http::Endpoint::Options options) {
+        options.threads(static_cast<int>(_options.threads));
+        options.maxRequestSize(_options.max_request_bytes);
+        if (_options.listeners > 1) {
+            options.flags(Pistache::Tcp::Options::ReuseAddr | Pistache::Tcp::Options::ReusePort);
+        }
+        for (const auto& end_point : _end_points) {
+            end_point->init(options);
+        }
+    }
+
+    // Router handler is cloned per reactor thread, listeners may share it.
+    // It's put behind admission control if any of its limits is set, clients
+    // are told apart by the user authenticate vouches for or their address.
+    void setHandler(std::shared_ptr<Pistache::Http::Handler> handler, Authenticator authenticate = {}) {
+        if (_options.admission.enabled()) {
+            handler = std::make_shared<AdmissionHandler>(
+                std::move(handler), std::make_shared<AdmissionHandler::State>(_options.admission, std::move(authenticate))
+            );
+        }
+        for (const auto& end_point : _end_points) {
+            end_point->setHandler(handler);
+        }
+    }
+
+    // Blocks until SIGINT or SIGTERM, then shuts listeners down.
+    void serve() {
+        // Reactor threads inherit the mask, signals are only taken by sigwait below.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        cpu_set_t original;
+        CPU_ZERO(&original);
+        sched_getaffinity(0, sizeof(original), &original);
+        const auto nodes = _options.pin ? cpuNodes() : std::vector<std::vector<int>>{};
+
+        // Threads inherit affinity and memory policy of the thread creating them.
+        for (uint i = 0; i < _end_points.size(); ++i) {
+            if (_options.pin) {
+                place(i, nodes);
+            }
+            _end_points[i]->serveThreaded();
+        }
+        if (_options.pin) {
+            sched_setaffinity(0, sizeof(original), &original);
+            if (_options.numa) {
+                syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0);
+            }
+        }
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+        spdlog::info("Received signal {}, shutting down", signal);
+        shutdown();
+    }
+
+    void shutdown() {
+        for (const auto& end_point : _end_points) {
+            end_point->shutdown();
+        }
+    }
+
+private:
+    // Listener i gets `threads` consecutive cores. Without NUMA they're taken from
+    // all CPUs, with it listeners go round-robin over nodes, cores from one node.
+    void place(uint listener, const std::vector<std::vector<int>>& nodes) {
+        std::vector<int> all;
+        for (const auto& node : nodes) {
+            all.insert(all.end(), node.begin(), node.end());
+        }
+        const auto& cpus = _options.numa ? nodes[listener % nodes.size()] : all;
+        const auto first = (_options.numa ? listener / nodes.size() : listener) * _options.threads;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        std::vector<int> chosen;
+        for (uint thread = 0; thread < _options.threads; ++thread) {
+            const auto cpu = cpus[(first + thread) % cpus.size()];
+            CPU_SET(cpu, &set);
+            chosen.push_back(cpu);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            spdlog::warn("Couldn't pin listener {}", listener);
+        }
+        if (_options.numa && syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) != 0) {
+            spdlog::warn("Couldn't set local memory policy for listener {}", listener);
+        }
+        spdlog::info("Listener {} runs on cpus {}", listener, fmt::join(chosen, ","));
+    }
+
+    ServingOptions _options;
+    std::vector<std::shared_ptr<Pistache::Http::Endpoint>> _end_points;
+};
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef COMMON_SUBSTRING_SCAN_H
+#define COMMON_SUBSTRING_SCAN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+#include "row_slots.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMMON_SCAN_X86
+#endif
+
+namespace common {
+
+namespace detail {
+
+// Candidates are positions where both the first and the last byte of the
+// needle match, compared 16 or 32 at a time, only those get a full compare.
+inline bool matchesInner(const char* at, std::string_view needle) {
+    return needle.size() <= 2 || std::memcmp(at + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+inline std::size_t findScalar(std::string_view haystack, std::string_view needle, std::size_t from) {
+    const auto pos = haystack.find(needle, from);
+    return pos == std::string_view::npos ? haystack.size() : pos;
+}
+
+#ifdef COMMON_SCAN_X86
+__attribute__((target("sse2")))
+inline std::size_t findSse2(std::string_view haystack, std::string_view needle, std::size_t from) {
+    const auto k = needle.size();
+    const auto first = _mm_set1_epi8(needle.front());
+    const auto last = _mm_set1_epi8(needle.back());
+    const char* data = haystack.data();
+    std::size_t i = from;
+    for (; i + k - 1 + 16 <= haystack.size(); i += 16) {
+        const auto block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const auto block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + k - 1));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))
+        ));
+        while (mask != 0) {
+            const auto bit = static_cast<std::size_t>(__builtin_ctz(mask));
+            if (matchesInner(data + i + bit, needle)) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(haystack, needle, i);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t findAvx2(std::string_view haystack, std::string_view needle, std::size_t from) {
+    const auto k = needle.size();
+    const auto first = _mm256_set1_epi8(needle.front());
+    const auto last = _mm256_set1_epi8(needle.back());
+    const char* data = haystack.data();
+    std::size_t i = from;
+    for (; i + k - 1 + 32 <= haystack.size(); i += 32) {
+        const auto block_first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const auto block_last = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + k - 1));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last))
+        ));
+        while (mask != 0) {
+            const auto bit = static_cast<std::size_t>(__builtin_ctz(mask));
+            if (matchesInner(data + i + bit, needle)) {
+                return i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSse2(haystack, needle, i);
+}
+#endif
+
+using FindFunction = std::size_t (*)(std::string_view, std::string_view, std::size_t);
+
+inline FindFunction selectFind() {
+#ifdef COMMON_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &findAvx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return &findSse2;
+    }
+#endif
+    return &findScalar;
+}
+
+inline FindFunction find() {
+    static const auto function = selectFind();
+    return function;
+}
+
+}
+
+// Instruction set picked once, on first use.
+inline std::string_view findImplementation() {
+#ifdef COMMON_SCAN_X86
+    const auto find = detail::find();
+    return find == &detail::findAvx2 ? "avx2" : find == &detail::findSse2 ? "sse2" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+// First occurrence of needle at or after from, haystack.size() if there's none.
+inline std::size_t findSubstring(std::string_view haystack, std::string_view needle, std::size_t from = 0) {
+    if (needle.empty()) {
+        return std::min(from, haystack.size());
+    }
+    if (from + needle.size() > haystack.size()) {
+        return haystack.size();
+    }
+    return detail::find()(haystack, needle, from);
+}
+
+// Strings of a row store copied back to back into one buffer, so a scan over
+// all of them is one pass over contiguous memory instead of a pointer chase
+// per row. The buffer is only appended to: a replaced or erased row's bytes
+// stay behind as garbage, skipped by scans, until there's more of it than of
+// live bytes and the buffer is rewritten without it. So is the bookkeeping of
+// rows, on RowSlots, an edit doesn't move what comes after it.
+// Not synchronized, it's guarded together with the store it mirrors.
+class StringColumn {
+public:
+    std::size_t size() const noexcept {
+        return _rows.size();
+    }
+
+    std::string_view operator[](std::size_t row) const {
+        const auto& span = _spans[_slot_spans[_rows.slot(row)]];
+        return std::string_view(_bytes).substr(span.begin, span.end - span.begin);
+    }
+
+    void append(std::string_view value) {
+        _slot_spans.push_back(static_cast<uint32_t>(_spans.size()));
+        pushSpan(_rows.append(), value);
+    }
+
+    void replace(std::size_t row, std::string_view value) {
+        const auto slot = _rows.slot(row);
+        discard(_slot_spans[slot]);
+        _slot_spans[slot] = static_cast<uint32_t>(_spans.size());
+        pushSpan(slot, value);
+        compactIfNeeded();
+    }
+
+    void erase(std::size_t row) {
+        const auto slot = _rows.slot(row);
+        discard(_slot_spans[slot]);
+        _rows.erase(slot);
+        compactIfNeeded();
+    }
+
+    // Rows containing needle, ascending. A match spanning two rows doesn't count.
+    std::vector<std::size_t> contains(std::string_view needle) const {
+        std::vector<std::size_t> rows;
+        if (needle.empty()) {
+            rows.resize(size());
+            for (std::size_t row = 0; row < rows.size(); ++row) {
+                rows[row] = row;
+            }
+            return rows;
+        }
+        std::size_t pos = 0;
+        while ((pos = findSubstring(_bytes, needle, pos)) < _bytes.size()) {
+            // Last span starting at or before pos, empty spans before it don't hold anything.
+            const auto& span = *(std::upper_bound(_spans.begin(), _spans.end(), pos,
+                [](std::size_t at, const Span& span) { return at < span.begin; }) - 1);
+            if (span.slot == RowSlots::erased) {
+                pos = span.end;
+            } else if (pos + needle.size() <= span.end) {
+                rows.push_back(_rows.position(span.slot));
+                pos = span.end;
+            } else {
+                ++pos;
+            }
+        }
+        // Replaced rows are stored after the ones they came before.
+        std::sort(rows.begin(), rows.end());
+        return rows;
+    }
+
+private:
+    struct Span {
+        std::size_t begin;
+        std::size_t end;
+        // RowSlots::erased once it's garbage.
+        uint32_t slot;
+    };
+
+    void pushSpan(uint32_t slot, std::string_view value) {
+        _spans.push_back({ _bytes.size(), _bytes.size() + value.size(), slot });
+        _bytes.append(value);
+    }
+
+    void discard(uint32_t span) {
+        _spans[span].slot = RowSlots::erased;
+        _garbage += _spans[span].end - _spans[span].begin;
+    }
+
+    void compactIfNeeded() {
+        const auto dead_spans = _spans.size() - _rows.size();
+        if ((_garbage > 64 * 1024 && _garbage > _bytes.size() / 2) || (dead_spans > 64 && dead_spans > _rows.size())) {
+            compact();
+        }
+    }
+
+    // Live rows copied in row order into a new buffer, slots renumbered without tombstones.
+    void compact() {
+        std::string bytes;
+        bytes.reserve(_bytes.size() - _garbage);
+        std::vector<Span> spans;
+        spans.reserve(_rows.size());
+        std::vector<uint32_t> slot_spans;
+        slot_spans.reserve(_rows.size());
+        const auto renamed = _rows.compact();
+        for (uint32_t slot = 0; slot < renamed.size(); ++slot) {
+            if (renamed[slot] == RowSlots::erased) {
+                continue;
+            }
+            const auto& span = _spans[_slot_spans[slot]];
+            slot_spans.push_back(static_cast<uint32_t>(spans.size()));
+            spans.push_back({ bytes.size(), bytes.size() + (span.end - span.begin), renamed[slot] });
+            bytes.append(_bytes, span.begin, span.end - span.begin);
+        }
+        _bytes = std::move(bytes);
+        _spans = std::move(spans);
+        _slot_spans = std::move(slot_spans);
+        _garbage = 0;
+    }
+
+    std::string _bytes;
+    // In buffer order, which is the order they were written in.
+    std::vector<Span> _spans;
+    // Slot -> its row's current span.
+    std::vector<uint32_t> _slot_spans;
+    RowSlots _rows;
+    std::size_t _garbage = 0;
+};
+
+}
+
+#endif
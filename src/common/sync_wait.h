@@ -0,0 +1,69 @@
+#ifndef COMMON_SYNC_WAIT_H
+#define COMMON_SYNC_WAIT_H
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <exception>
+#include <string>
+
+#include <fmt/format.h>
+
+#include <pistache/async.h>
+
+namespace common {
+
+struct TimeoutError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Bridges pistache promise into std::future. Promise is settled on the client's
+// reactor thread, whoever waits on the future sleeps instead of spinning.
+template<typename T>
+std::future<T> toFuture(Pistache::Async::Promise<T>&& promise) {
+    auto bridge = std::make_shared<std::promise<T>>();
+    auto future = bridge->get_future();
+    promise.then(
+        [bridge](const T& value) { bridge->set_value(value); },
+        [bridge](std::exception_ptr& e) { bridge->set_exception(e); }
+    );
+    return future;
+}
+
+// Blocks until promise is settled or deadline passes. Rejections are rethrown,
+// missed deadline throws TimeoutError.
+template<typename T>
+T waitUntil(Pistache::Async::Promise<T>&& promise, std::chrono::steady_clock::time_point deadline) {
+    auto future = toFuture(std::move(promise));
+    if (future.wait_until(deadline) != std::future_status::ready) {
+        throw TimeoutError("Deadline passed before response arrived");
+    }
+    return future.get();
+}
+
+// Message of rejection reason passed to promise's reject callback.
+inline std::string describe(const std::exception_ptr& e) {
+    try {
+        std::rethrow_exception(e);
+    } catch (const std::exception& ex) {
+        return ex.what();
+    } catch (...) {
+        return "Unknown error";
+    }
+}
+
+template<typename T, typename Rep, typename Period>
+T waitFor(Pistache::Async::Promise<T>&& promise, std::chrono::duration<Rep, Period> timeout) {
+    auto future = toFuture(std::move(promise));
+    if (future.wait_for(timeout) != std::future_status::ready) {
+        throw TimeoutError(fmt::format(
+            "No response within {} ms", std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count()
+        ));
+    }
+    return future.get();
+}
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+// Admission control against a real endpoint with a single reactor thread.
+// More slow requests at once than the in-flight limit allows: the handler
+// answers from threads of its own, holding admission until it did, and what's
+// over the limit has to be refused with 503 and Retry-After. Requests parked
+// without a hold, as long polls and streams are, don't take a slot. A client
+// over its rate is refused with 429 and Retry-After.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <pistache/endpoint.h>
+#include <pistache/http.h>
+
+#include "common/admission.h"
+
+using namespace Pistache;
+
+namespace {
+
+constexpr std::size_t max_in_flight = 2;
+constexpr std::size_t clients = 6;
+constexpr std::size_t parked_clients = max_in_flight + 1;
+constexpr auto handling = std::chrono::milliseconds(300);
+
+// Threads answering /slow, joined before the endpoint shuts down.
+std::mutex responders_m;
+std::vector<std::thread> responders;
+
+// Writers of /parked requests, answered by the test itself.
+std::mutex parked_m;
+std::condition_variable parked_cv;
+std::vector<Http::ResponseWriter> parked;
+
+// /fast answers right away. /slow answers later from a thread of its own, as a
+// continuation would, and holds admission until then. /parked leaves its writer
+// for later without a hold, as a long poll or a stream would.
+class TestHandler : public Http::Handler {
+public:
+    HTTP_PROTOTYPE(TestHandler)
+
+    void onRequest(const Http::Request& request, Http::ResponseWriter response) override {
+        if (request.resource() == "/slow") {
+            std::lock_guard<std::mutex> lock(responders_m);
+            responders.emplace_back([response = std::move(response), admission = common::holdAdmission()]() mutable {
+                std::this_thread::sleep_for(handling);
+                response.send(Http::Code::Ok, "done", MIME(Text, Plain));
+                admission.reset();
+            });
+        } else if (request.resource() == "/parked") {
+            {
+                std::lock_guard<std::mutex> lock(parked_m);
+                parked.push_back(std::move(response));
+            }
+            parked_cv.notify_all();
+        } else {
+            response.send(Http::Code::Ok, "done", MIME(Text, Plain));
+        }
+    }
+};
+
+struct Server {
+    Http::Endpoint end_point;
+
+    explicit Server(const common::AdmissionOptions& options)
+        : end_point(Address("127.0.0.1", Port(0))) {
+        end_point.init(Http::Endpoint::options().threads(1).flags(Tcp::Options::ReuseAddr));
+        end_point.setHandler(std::make_shared<common::AdmissionHandler>(
+            std::make_shared<TestHandler>(),
+            std::make_shared<common::AdmissionHandler::State>(options)
+        ));
+        end_point.serveThreaded();
+    }
+    ~Server() {
+        end_point.shutdown();
+    }
+
+    uint16_t port() {
+        return end_point.getPort();
+    }
+};
+
+// Connection with the request for path sent on it, -1 on error.
+int request(uint16_t port, const std::string& path) {
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const std::string text = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::send(fd, text.data(), text.size(), 0) != static_cast<ssize_t>(text.size())) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whole response read off a connection, which is closed then. Empty on error.
+std::string response(int fd) {
+    if (fd < 0) {
+        return {};
+    }
+    std::string text;
+    char buffer[4096];
+    ssize_t read = 0;
+    while ((read = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        text.append(buffer, static_cast<std::size_t>(read));
+    }
+    ::close(fd);
+    return text;
+}
+
+std::string get(uint16_t port, const std::string& path) {
+    return response(request(port, path));
+}
+
+bool startsWith(const std::string& response, const std::string& status) {
+    return response.rfind(status, 0) == 0;
+}
+
+// Whether response has status and a Retry-After, complains otherwise.
+bool refused(const std::string& response, const std::string& status) {
+    if (!startsWith(response, status)) {
+        return false;
+    }
+    if (response.find("Retry-After:") == std::string::npos) {
+        std::cerr << "refused without Retry-After:\n" << response << '\n';
+        return false;
+    }
+    return true;
+}
+
+void joinResponders() {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(responders_m);
+        threads.swap(responders);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+bool checkInFlight() {
+    common::AdmissionOptions options;
+    options.max_in_flight = max_in_flight;
+    Server server(options);
+    bool failed = false;
+
+    std::vector<std::string> responses(clients);
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 0; i < clients; ++i) {
+            threads.emplace_back([&responses, i, port = server.port()] { responses[i] = get(port, "/slow"); });
+        }
+    }
+
+    std::size_t ok = 0;
+    std::size_t busy = 0;
+    for (const auto& response : responses) {
+        if (startsWith(response, "HTTP/1.1 200")) {
+            ++ok;
+        } else if (refused(response, "HTTP/1.1 503")) {
+            ++busy;
+        } else {
+            std::cerr << "unexpected response:\n" << response << '\n';
+            failed = true;
+        }
+    }
+    // Held admission keeps the slow requests in flight after their handler
+    // returned, so they still count when the next ones arrive.
+    if (ok == 0) {
+        std::cerr << "no request handled\n";
+        failed = true;
+    }
+    if (busy == 0) {
+        std::cerr << "none of " << clients << " requests refused with 503\n";
+        failed = true;
+    }
+
+    // Admitted again once the responders let go of their holds.
+    joinResponders();
+    if (!startsWith(get(server.port(), "/fast"), "HTTP/1.1 200")) {
+        std::cerr << "request after the slow ones wasn't admitted\n";
+        failed = true;
+    }
+
+    // More parked requests than the limit, all of them got to the handler and
+    // none holds a slot, so another request still gets in.
+    std::vector<int> connections;
+    for (std::size_t i = 0; i < parked_clients; ++i) {
+        connections.push_back(request(server.port(), "/parked"));
+    }
+    {
+        std::unique_lock<std::mutex> lock(parked_m);
+        if (!parked_cv.wait_for(lock, std::chrono::seconds(5), [] { return parked.size() == parked_clients; })) {
+            std::cerr << "only " << parked.size() << " of " << parked_clients << " parked requests admitted\n";
+            failed = true;
+        }
+    }
+    if (!startsWith(get(server.port(), "/fast"), "HTTP/1.1 200")) {
+        std::cerr << "parked requests took in-flight slots\n";
+        failed = true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(parked_m);
+        for (auto& writer : parked) {
+            writer.send(Http::Code::Ok, "done", MIME(Text, Plain));
+        }
+        parked.clear();
+    }
+    for (const int fd : connections) {
+        if (!startsWith(response(fd), "HTTP/1.1 200")) {
+            std::cerr << "parked request wasn't answered\n";
+            failed = true;
+        }
+    }
+    return !failed;
+}
+
+bool checkRate() {
+    common::AdmissionOptions options;
+    options.rate = 1;
+    options.burst = 1;
+    Server server(options);
+    bool failed = false;
+
+    if (!startsWith(get(server.port(), "/fast"), "HTTP/1.1 200")) {
+        std::cerr << "first request over the rate limit\n";
+        failed = true;
+    }
+    if (const auto second = get(server.port(), "/fast"); !refused(second, "HTTP/1.1 429")) {
+        std::cerr << "request right after the burst not refused with 429:\n" << second << '\n';
+        failed = true;
+    }
+    return !failed;
+}
+
+}
+
+int main() {
+    const bool in_flight = checkInFlight();
+    const bool rate = checkRate();
+    return in_flight && rate ? 0 : 1;
+}
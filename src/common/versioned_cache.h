@@ -0,0 +1,62 @@
+#ifndef COMMON_VERSIONED_CACHE_H
+#define COMMON_VERSIONED_CACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#include "compression.h"
+
+namespace common {
+
+// Serialized responses keyed by whatever identifies them, valid for a single
+// version of the data they were built from. First lookup after the version
+// changed drops everything. Values are EncodedBody so compressed variants are
+// cached together with the serialized one.
+template<typename Key>
+class VersionedCache {
+public:
+    using Value = std::shared_ptr<const EncodedBody>;
+
+    explicit VersionedCache(CompressionOptions options = {}, std::size_t capacity = 256)
+        : _options(options),
+          _capacity(capacity) {}
+
+    // Producer returns serialized body, it's called without holding the lock.
+    template<typename Producer>
+    Value get(const Key& key, uint64_t version, Producer&& produce) {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (version != _version) {
+                _entries.clear();
+                _version = version;
+            }
+            if (const auto it = _entries.find(key); it != _entries.end()) {
+                return it->second;
+            }
+        }
+        auto value = std::make_shared<const EncodedBody>(produce(), _options);
+
+        std::lock_guard<std::mutex> lock(_m);
+        if (version == _version) {
+            if (_entries.size() >= _capacity) {
+                _entries.clear();
+            }
+            _entries.emplace(key, value);
+        }
+        return value;
+    }
+
+private:
+    CompressionOptions _options;
+    std::size_t _capacity;
+    uint64_t _version{ 0 };
+    std::unordered_map<Key, Value> _entries;
+    std::mutex _m;
+};
+
+}
+
+#endif
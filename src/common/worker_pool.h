@@ -0,0 +1,86 @@
+#ifndef COMMON_WORKER_POOL_H
+#define COMMON_WORKER_POOL_H
+
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+namespace common {
+
+// Fixed set of threads running tasks in the order they were submitted, for
+// CPU bound work split off a request, so requests don't start threads of
+// their own. Tasks mustn't wait for other tasks of the pool.
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(unsigned threads) {
+        threads = std::max(threads, 1U);
+        _workers.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) {
+            _workers.emplace_back([this] { work(); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Tasks still queued are run before the workers quit.
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _stopped = true;
+        }
+        _cv.notify_all();
+    }
+
+    // One a core, less the thread which submitted the work and waits for it.
+    static WorkerPool& shared() {
+        static WorkerPool pool(std::max(std::thread::hardware_concurrency(), 2U) - 1);
+        return pool;
+    }
+
+    std::size_t size() const noexcept {
+        return _workers.size();
+    }
+
+    void submit(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _tasks.push(std::move(task));
+        }
+        _cv.notify_one();
+    }
+
+private:
+    void work() {
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_m);
+                _cv.wait(lock, [this] { return _stopped || !_tasks.empty(); });
+                if (_tasks.empty()) {
+                    return;
+                }
+                task = std::move(_tasks.front());
+                _tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::queue<Task> _tasks;
+    bool _stopped = false;
+    std::mutex _m;
+    std::condition_variable _cv;
+    // Last member, joined before the rest is gone.
+    std::vector<std::jthread> _workers;
+};
+
+}
+
+#endif
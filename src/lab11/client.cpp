@@ -1,66 +1,92 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <type_traits>
+
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
-#include <pistache/client.h>
+#include <nlohmann/json.hpp>
+
+#include "common/sync_wait.h"
+#include "messages_client.h"
 
 using namespace Pistache;
 
-std::atomic<bool> response_str_set = false;
-std::string response_str = "";
+constexpr auto response_timeout = std::chrono::seconds(5);
 
-void print(Async::Promise<Http::Response>&& response) {
+template<typename T>
+void print(Async::Promise<T>&& result) {
     try {
-        response.then(
-            [](const Http::Response& response) { response_str = response.body(); response_str_set = true; },
-            Async::Throw
-        );    
-    } catch (std::exception e) {
+        const auto value = common::waitFor(std::move(result), response_timeout);
+        if constexpr (std::is_same_v<T, std::string>) {
+            fmt::print("{}\n", value);
+        } else {
+            fmt::print("{}\n", nlohmann::json(value).dump(2));
+        }
+    } catch (const std::exception& e) {
         spdlog::error(e.what());
     }
 }
 
 int main(int argc, char** argv) {
-    const auto base_addr = fmt::format("localhost:{}/", argv[1]);
-
-    Http::Experimental::Client client{};
-
-    auto opts = Http::Experimental::Client::options().threads(1).maxConnectionsPerHost(8);
-    client.init(opts);
+    const MessagesClient client(fmt::format("localhost:{}", argv[1]));
 
-    std::string body = "{ \"author\": \"Eliasz\", \"id\": 4, \"contents\": \"Czesc\" }";
+    const ns::Message message{ "Eliasz", 4, "Czesc" };
 
     switch (argv[2][0]) {
         // get messages
     case '0':
-        print(client.get(base_addr + "messages").send());
+        print(client.messages());
         break;
         // get message
     case '1':
-        print(client.get(base_addr + fmt::format("message/{}", argv[3])).send());
+        print(client.message(std::stoul(argv[3])));
         break;
         // post message
     case '2':
-        print(client.post(base_addr + "message").body(std::move(body)).send());
+        print(client.create(message));
         break;
         // put message
     case '3':
-        print(client.put(base_addr + fmt::format("message/{}", argv[3])).body(std::move(body)).send());
+        print(client.update(std::stoul(argv[3]), message));
         break;
         // del message
     case '4':
-        print(client.del(base_addr + fmt::format("message/{}", argv[3])).send());
+        print(client.remove(std::stoul(argv[3])));
         break;
         // query messages
     case '5':
-        print(client.get(base_addr + fmt::format("messages/{}", argv[3])).send());
+        print(client.startingWith(argv[3]));
+        break;
+        // messages containing
+    case '6':
+        print(client.containing(argv[3]));
+        break;
+        // full-text search
+    case '7':
+        try {
+            for (const auto& hit : common::waitFor(client.search(argv[3]), response_timeout)) {
+                fmt::print("{} {:.3f} {}\n", hit.id, hit.score, nlohmann::json(hit.message).dump());
+            }
+        } catch (const std::exception& e) {
+            spdlog::error(e.what());
+        }
+        break;
+        // patch message with a merge patch
+    case '8':
+        print(client.patch(std::stoul(argv[3]), nlohmann::json::parse(argv[4])));
         break;
+        // get given messages at once
+    case '9': {
+        std::vector<Async::Promise<ns::Message>> calls;
+        for (int i = 3; i < argc; ++i) {
+            calls.push_back(client.message(std::stoul(argv[i])));
+        }
+        print(common::ApiClient::all(std::move(calls)));
+        break;
+    }
     default:
         spdlog::error("No such option");
         break; 
     }
-    while (!response_str_set) {}
-
-    fmt::print("{}\n", response_str);
-
-    client.shutdown();
-
-}
\ No newline at end of file
+}
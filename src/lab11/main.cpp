@@ -3,6 +3,9 @@
 #include <string>
 #include <string_view>
 #include <algorithm>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
 
 #include <spdlog/spdlog.h>
 #include <fmt/format.h>
@@ -11,6 +14,20 @@
 #include <pistache/endpoint.h>
 #include <pistache/router.h>
 #include <pistache/mime.h>
+
+#include "common/versioned_cache.h"
+#include "common/encoded_response.h"
+#include "common/serving.h"
+#include "common/mvcc.h"
+#include "common/search_index.h"
+#include "common/substring_scan.h"
+#include "common/expected.h"
+#include "common/error_response.h"
+#include "common/ndjson.h"
+#include "common/export_file.h"
+#include "common/file_response.h"
+#include "common/change_log.h"
+#include "common/change_publisher.h"
 #include <pistache/serializer/rapidjson.h>
 
 using namespace Pistache;
@@ -18,30 +35,66 @@ using namespace Pistache;
 #include <nlohmann/json.hpp>
 using namespace nlohmann::literals;
 
-namespace ns {
-    struct Message {
-        std::string author;
-        uint id;
-        std::string contents;
-    };
-}
+#include "message.h"
 using Message = ns::Message;
 
-std::vector<Message> messages {
+// Readers work on snapshots, a long scan neither blocks nor is blocked by writes.
+common::MvccVector<Message> messages {
     { "Piotr", 0, "Cześć" },    
     { "Jacek", 1, "Cześć" },   
     { "Jarek", 2, "Cześć" }    
 };
 
-const Message& dbGetMessage(std::size_t id) {
-    if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+// Words of a message the search index knows about.
+std::vector<common::SearchIndex::Field> searchFields(const Message& message) {
+    return { { message.contents } };
+}
+// Full-text index over messages, kept up to date by the db* functions below.
+common::SearchIndex messages_index = [] {
+    common::SearchIndex index;
+    for (const auto& message : messages.snapshot()) {
+        index.append(searchFields(message));
+    }
+    return index;
+}();
+
+// Contents of all messages back to back, for substring scans no index helps with.
+common::StringColumn messages_contents = [] {
+    common::StringColumn column;
+    for (const auto& message : messages.snapshot()) {
+        column.append(message.contents);
+    }
+    return column;
+}();
+
+// Bumped by every modification, cached responses built from older version are stale.
+std::atomic<uint64_t> messages_version = 0;
+// Keeps the indexes in step with messages: writers own it, index lookups share
+// it. Reads of messages alone go to a snapshot without taking it.
+std::shared_mutex messages_mutex;
+
+// Missing ids are routine (scans, stale links), they're returned rather than thrown.
+const common::Error no_such_message{ common::Errc::NotFound, "No such message" };
+
+// Every write as it happened, for consumers keeping a copy of messages up to
+// date. Versions are those of messages' snapshots, the export's ETag among them.
+common::ChangeLog<Message> messages_changes;
+
+// Records the write just done to messages, writers call it holding messages_mutex.
+void recordChange(common::ChangeKind kind, std::size_t id, std::optional<Message> value = std::nullopt) {
+    messages_changes.record({ messages.version(), kind, id, std::move(value) });
+}
+
+common::Expected<Message> dbGetMessage(std::size_t id) {
+    const auto snapshot = messages.snapshot();
+    if (id >= snapshot.size()) {
+        return no_such_message;
     }
-    return messages[id];
+    return snapshot[id];
 }
 std::vector<Message> dbGetMessagesStartingWith(std::string_view query) {
     std::vector<Message> result;
-    for (const auto& message : messages) {
+    for (const auto& message : messages.snapshot()) {
         if (std::string_view(message.contents).substr(0, query.size()).compare(query.data()) == 0) {
             result.push_back(message);
         }
@@ -50,47 +103,164 @@ std::vector<Message> dbGetMessagesStartingWith(std::string_view query) {
 }
 std::vector<Message> dbGetMessagesMatching(const Message& m) {
     std::vector<Message> result;
-    for (const auto& message : messages) {
+    for (const auto& message : messages.snapshot()) {
         if (message.contents == m.contents && message.author == m.author) {
             result.push_back(message);
         }
     }
     return result;
 }
-const std::vector<Message>& dbGetMessages() noexcept {
-    return messages;
+std::vector<Message> dbGetMessagesContaining(std::string_view query) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<Message> result;
+    for (const auto id : messages_contents.contains(query)) {
+        result.push_back(snapshot[id]);
+    }
+    return result;
+}
+std::vector<std::pair<common::SearchIndex::Hit, Message>> dbSearchMessages(std::string_view query, std::size_t limit) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<std::pair<common::SearchIndex::Hit, Message>> result;
+    for (const auto& hit : messages_index.search(query, limit)) {
+        result.emplace_back(hit, snapshot[hit.position]);
+    }
+    return result;
+}
+// Serializing straight from the snapshot, nothing is copied and writes go on meanwhile.
+common::MvccVector<Message>::Snapshot dbGetMessages() {
+    return messages.snapshot();
 }
-void dbCreateMessage(const Message& message) {
-    messages.push_back(message);
+std::size_t dbCreateMessage(const Message& message) {
+    std::unique_lock lock(messages_mutex);
+    const auto id = messages.push_back(message);
+    recordChange(common::ChangeKind::Create, id, message);
+    messages_index.append(searchFields(message));
+    messages_contents.append(message.contents);
+    ++messages_version;
+    return id;
 }
-void dbUpdateMessage(const Message& message, std::size_t id) {
+// Whole batch under one lock and in a single version, readers see all of it or none.
+// An empty one writes nothing, a version without changes would be a gap in the feed.
+std::size_t dbImportMessages(std::vector<Message> imported) {
+    std::unique_lock lock(messages_mutex);
+    if (imported.empty()) {
+        return messages.size();
+    }
+    for (const auto& message : imported) {
+        messages_index.append(searchFields(message));
+        messages_contents.append(message.contents);
+    }
+    const auto first = messages.append_range(std::move(imported));
+    const auto version = messages.version();
+    const auto size = messages.size();
+    std::vector<common::Change<Message>> changes;
+    changes.reserve(size - first);
+    for (auto id = first; id < size; ++id) {
+        changes.push_back({ version, common::ChangeKind::Create, id, *messages.latest(id) });
+    }
+    messages_changes.record(std::move(changes));
+    ++messages_version;
+    return first;
+}
+common::Expected<void> dbUpdateMessage(const Message& message, std::size_t id) {
+    std::unique_lock lock(messages_mutex);
     if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+        return no_such_message;
     }
-    messages[id] = message;
+    messages.set(id, message);
+    recordChange(common::ChangeKind::Update, id, message);
+    messages_index.replace(id, searchFields(message));
+    messages_contents.replace(id, message.contents);
+    ++messages_version;
+    return {};
 }
-void dbDeleteMessage(std::size_t id) {
+common::Expected<void> dbDeleteMessage(std::size_t id) {
+    std::unique_lock lock(messages_mutex);
     if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+        return no_such_message;
     }
-    messages.erase(std::next(messages.begin(), id));
+    messages.erase(id);
+    recordChange(common::ChangeKind::Delete, id);
+    messages_index.erase(id);
+    messages_contents.erase(id);
+    ++messages_version;
+    return {};
 }
 
-namespace ns {
-    void to_json(nlohmann::json& j, const Message& m) {
-        j = nlohmann::json{
-            {"author", m.author},
-            {"id", m.id},
-            {"contents", m.contents}
-        };
+// Fields a merge patch actually changed, anything else keeps its cache and index entries.
+struct MessageChanges {
+    bool author = false;
+    bool id = false;
+    bool contents = false;
+
+    bool any() const noexcept {
+        return author || id || contents;
+    }
+};
+
+// Replaces field with value unless they're equal, returns whether it did.
+template<typename T>
+bool patchField(T& field, const nlohmann::json& value) {
+    auto patched = value.get<T>();
+    if (patched == field) {
+        return false;
+    }
+    field = std::move(patched);
+    return true;
+}
+
+// RFC 7396 merge patch of a message. Every field is required, so none can be
+// removed with null, and there are no nested objects to merge into.
+common::Expected<MessageChanges> applyPatch(Message& message, const nlohmann::json& patch) {
+    if (!patch.is_object()) {
+        return common::Error{ common::Errc::BadRequest, "Merge patch of a message has to be an object" };
+    }
+    MessageChanges changes;
+    for (const auto& [key, value] : patch.items()) {
+        if (value.is_null()) {
+            return common::Error{ common::Errc::BadRequest, fmt::format("Field {} can't be removed", key) };
+        }
+        if (key == "author") {
+            changes.author = patchField(message.author, value);
+        } else if (key == "id") {
+            changes.id = patchField(message.id, value);
+        } else if (key == "contents") {
+            changes.contents = patchField(message.contents, value);
+        } else {
+            return common::Error{ common::Errc::BadRequest, fmt::format("Unknown field {}", key) };
+        }
+    }
+    return changes;
+}
+
+// Patched copy replaces the stored message, only indexes over changed fields
+// are touched and a patch changing nothing leaves cached responses valid.
+common::Expected<MessageChanges> dbPatchMessage(const nlohmann::json& patch, std::size_t id) {
+    std::unique_lock lock(messages_mutex);
+    if (id >= messages.size()) {
+        return no_such_message;
+    }
+    const auto stored = messages.latest(id);
+    auto message = *stored;
+    const auto patched = applyPatch(message, patch);
+    if (!patched || !patched->any()) {
+        return patched;
     }
-    void from_json(const nlohmann::json& j, Message& m) {
-        j.at("author").get_to(m.author);
-        j.at("id").get_to(m.id);
-        j.at("contents").get_to(m.contents);
+    const auto& changes = *patched;
+    if (changes.contents) {
+        messages_index.replace(id, searchFields(message));
+        messages_contents.replace(id, message.contents);
     }
+    messages.set(id, message);
+    recordChange(common::ChangeKind::Update, id, std::move(message));
+    ++messages_version;
+    return patched;
 }
-auto toJSON(const std::vector<Message>& messages) {
+
+template<typename Messages>
+auto toJSON(const Messages& messages) {
     nlohmann::json result;
     for (const auto& m : messages) {
         nlohmann::json j = m;
@@ -98,23 +268,66 @@ auto toJSON(const std::vector<Message>& messages) {
     }
     return result.dump();
 }
+auto toJSON(const std::vector<std::pair<common::SearchIndex::Hit, Message>>& hits) {
+    nlohmann::json result = nlohmann::json::array();
+    for (const auto& [hit, m] : hits) {
+        result.push_back({
+            {"id", hit.position},
+            {"score", hit.score},
+            {"message", m}
+        });
+    }
+    return result.dump();
+}
 
 struct MessagesService {
     using Self = MessagesService;
 
     uint16_t _port;
-    uint _num_threads;
+    common::ServingOptions _serving;
     Address _address{ "localhost", _port };
-    std::shared_ptr<Http::Endpoint> _end_point{ std::make_shared<Http::Endpoint>(_address) };
+    common::Endpoints _end_points{ _address, _serving };
     Rest::Description _desc{ "Message API", "0.1" };
     Rest::Router _router;
+    common::VersionedCache<std::string> _responses;
+    common::ExportFile<Message> _export;
+    std::unique_ptr<common::ChangePublisher<Message>> _changes_publisher;
 
-    MessagesService(uint16_t port, uint num_threads = std::thread::hardware_concurrency())
+    MessagesService(uint16_t port,
+                    common::ServingOptions serving = {},
+                    common::CompressionOptions compression = {},
+                    std::filesystem::path export_directory = "export",
+                    common::ChangeFeedOptions changes = {})
         : _port(port),
-          _num_threads(num_threads) {}
+          _serving(serving),
+          _responses(compression),
+          _export(std::move(export_directory), "messages") {
+        if (!changes.publish_to.empty()) {
+            _changes_publisher = std::make_unique<common::ChangePublisher<Message>>(
+                changes.publish_to, changes.topic, "messages"
+            );
+            messages_changes.listen([publisher = _changes_publisher.get()](const auto& changes) {
+                publisher->publish(changes);
+            });
+        }
+    }
 
     void getMessages(const Rest::Request& request, Http::ResponseWriter response) {
-        response.send(Http::Code::Ok, toJSON(messages), MIME(Application, Json));
+        try {
+            const auto contains = request.query().get("contains");
+            const auto body = contains
+                ? _responses.get(fmt::format("contains/{}", *contains), messages_version, [&] {
+                      return toJSON(dbGetMessagesContaining(*contains));
+                  })
+                : _responses.get("messages", messages_version, [] { return toJSON(dbGetMessages()); });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
     }
     void findMessages(const Rest::Request& request, Http::ResponseWriter response) {
         try {
@@ -134,12 +347,42 @@ struct MessagesService {
     }
     void findMessagesObject(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const Message message = nlohmann::json::parse(request.body());
-            if (const auto result = dbGetMessagesMatching(message); !result.empty()) {
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            if (const auto result = dbGetMessagesMatching(body->template get<Message>()); !result.empty()) {
                 response.send(Http::Code::Ok, toJSON(result), MIME(Application, Json));
             } else {
                 response.send(Http::Code::Ok, "No such messages...");
             }
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void searchMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto query = request.query().get("q");
+            if (!query || query->empty()) {
+                response.send(Http::Code::Bad_Request, "Missing q parameter", MIME(Text, Plain));
+                return;
+            }
+            const auto limit = common::numberQuery(request, "limit", 20);
+            if (!limit) {
+                common::sendError(response, limit.error());
+                return;
+            }
+            const auto body = _responses.get(fmt::format("search/{}/{}", *limit, *query), messages_version, [&] {
+                return toJSON(dbSearchMessages(*query, *limit));
+            });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -150,9 +393,17 @@ struct MessagesService {
     }
     void getMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            const auto& m = dbGetMessage(id);
-            nlohmann::json j = m;
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            const auto m = dbGetMessage(*id);
+            if (!m) {
+                common::sendError(response, m.error());
+                return;
+            }
+            nlohmann::json j = *m;
             response.send(Http::Code::Ok, j.dump(), MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
@@ -164,13 +415,19 @@ struct MessagesService {
     }
     void createMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            if (request.headers().has("/json")) {
-                throw std::runtime_error(
-                    fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString())
-                );
+            if (const auto json = common::requireJson(request); !json) {
+                common::sendError(response, json.error());
+                return;
             }
-            dbCreateMessage(nlohmann::json::parse(request.body()).template get<Message>());
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            dbCreateMessage(body->template get<Message>());
             response.send(Http::Code::Ok, "Message has been succesfully created!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -181,14 +438,152 @@ struct MessagesService {
     }
     void updateMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            if (request.headers().has("/json")) {
-                throw std::runtime_error(
-                    fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString())
-                );
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto json = common::requireJson(request); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            if (const auto updated = dbUpdateMessage(body->template get<Message>(), *id); !updated) {
+                common::sendError(response, updated.error());
+                return;
             }
-            dbUpdateMessage(nlohmann::json::parse(request.body()).template get<Message>(), id);
             response.send(Http::Code::Ok, "Message has been succesfully updated!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void patchMessage(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto json = common::requireJson(request, "application/merge-patch+json"); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto patch = common::jsonBody(request);
+            if (!patch) {
+                common::sendError(response, patch.error());
+                return;
+            }
+            if (const auto patched = dbPatchMessage(*patch, *id); !patched) {
+                common::sendError(response, patched.error());
+                return;
+            }
+            response.send(Http::Code::Ok, "Message has been succesfully patched!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // One message per line, lines are parsed in parallel and stored only if all of them are valid.
+    void importMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            if (const auto json = common::requireJson(request, "application/x-ndjson"); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto body = common::decodedBody(request, _serving.max_request_bytes);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            auto imported = common::parseNdjson<Message>(*body);
+            if (!imported) {
+                common::sendError(response, imported.error());
+                return;
+            }
+            const auto count = imported->size();
+            const auto first = dbImportMessages(std::move(*imported));
+            const nlohmann::json result{
+                {"imported", count},
+                {"first_id", first}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Snapshot taken up front, writes going on meanwhile don't show up half way through.
+    void exportMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            common::streamNdjson(response, dbGetMessages());
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Pre-serialized JSON array, rewritten from the first chunk changed since the
+    // last export and sent with sendfile. Resumable through Range.
+    void exportMessagesFile(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto file = _export.update(dbGetMessages());
+            common::sendFile(
+                request, response,
+                file->path.string(), file->size,
+                MIME(Application, Json),
+                fmt::format("\"{}\"", file->version)
+            );
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Changes after `since`, oldest first, and the version to ask for the next ones after.
+    void getChanges(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto since = common::numberQuery(request, "since");
+            if (!since) {
+                common::sendError(response, since.error());
+                return;
+            }
+            const auto limit = common::numberQuery(request, "limit", 1000);
+            if (!limit) {
+                common::sendError(response, limit.error());
+                return;
+            }
+            const auto page = messages_changes.since(*since, *limit, messages.version());
+            if (!page) {
+                common::sendError(response, page.error());
+                return;
+            }
+            const nlohmann::json result{
+                {"version", page->version},
+                {"changes", page->changes}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -199,8 +594,15 @@ struct MessagesService {
     }
     void deleteMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            dbDeleteMessage(id);
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto deleted = dbDeleteMessage(*id); !deleted) {
+                common::sendError(response, deleted.error());
+                return;
+            }
             response.send(Http::Code::Ok, "Message has been succesfully deleted!");
         } catch (const std::exception& e) {
             response.send(
@@ -212,9 +614,10 @@ struct MessagesService {
     }
 
     void run() {
-        spdlog::info("Server started on port {} with {} threads", _port, _num_threads);
+        spdlog::info("Server started on port {} with {} listeners of {} threads", _port, _serving.listeners, _serving.threads);
+        spdlog::info("Substring scans use {}", common::findImplementation());
 
-        _end_point->init(Http::Endpoint::options().threads(_num_threads));
+        _end_points.init(Http::Endpoint::options());
 
         describe();
 
@@ -227,9 +630,9 @@ struct MessagesService {
             .serializer(&Rest::Serializer::rapidJson)
             .install(_router);
 
-        _end_point->setHandler(_router.handler());
+        _end_points.setHandler(_router.handler());
 
-        _end_point->serve();
+        _end_points.serve();
     }
 
     void describe() {
@@ -243,6 +646,7 @@ struct MessagesService {
 
         version_path.route(_desc.get("/messages")).bind(&Self::getMessages, this)
             .produces(MIME(Application, Json))
+            .parameter<Rest::Type::String>("contains", "Only messages with contents containing this string.")
             .response(Http::Code::Ok, "You are OK")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
 
@@ -252,16 +656,54 @@ struct MessagesService {
             .response(Http::Code::Ok, "You are OK")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
 
+        version_path.route(_desc.get("/messages/export")).bind(&Self::exportMessages, this)
+            .produces(Http::Mime::MediaType::fromString("application/x-ndjson"))
+            .response(Http::Code::Ok, "All messages, one per line")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
+        version_path.route(_desc.get("/messages/export.json")).bind(&Self::exportMessagesFile, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "All messages as one JSON array")
+            .response(Http::Code::Partial_Content, "Requested part of the array")
+            .response(Http::Code::Requested_Range_Not_Satisfiable, "Range past the end of the array")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
+        version_path.route(_desc.post("/messages/import")).bind(&Self::importMessages, this)
+            .consumes(Http::Mime::MediaType::fromString("application/x-ndjson"))
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Number of imported messages and id of the first one")
+            .response(Http::Code::Bad_Request, "Some line isn't a valid message, nothing imported")
+            .response(Http::Code::Unsupported_Media_Type, "Body isn't NDJSON")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
         version_path.route(_desc.get("/messages/:startswith")).bind(&Self::findMessages, this)
             .produces(MIME(Application, Json))
             .parameter<Rest::Type::String>("startswith", "Query string to filter the messages with.")
             .response(Http::Code::Ok, "You are OK")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
 
+        version_path.route(_desc.get("/changes")).bind(&Self::getChanges, this)
+            .produces(MIME(Application, Json))
+            .parameter<Rest::Type::Integer>("since", "Version changes are wanted after, eg. ETag of the export.")
+            .parameter<Rest::Type::Integer>("limit", "About how many changes at most, 1000 by default. Whole writes are never split.")
+            .response(Http::Code::Ok, "Changes and the version to continue from")
+            .response(Http::Code::Bad_Request, "No since given")
+            .response(Http::Code::Gone, "Changes after since aren't kept anymore, start over from the export")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
+        version_path.route(_desc.get("/search")).bind(&Self::searchMessages, this)
+            .produces(MIME(Application, Json))
+            .parameter<Rest::Type::String>("q", "Words to look for in contents, best matches first.")
+            .parameter<Rest::Type::Integer>("limit", "Maximum number of results, 20 by default.")
+            .response(Http::Code::Ok, "You are OK")
+            .response(Http::Code::Bad_Request, "No query given")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
         version_path.route(_desc.get("/message/:id")).bind(&Self::getMessage, this)
             .produces(MIME(Application, Json))
             .parameter<Rest::Type::Integer>("id", "Id of the message.")
             .response(Http::Code::Ok, "You are OK")
+            .response(Http::Code::Not_Found, "No such message")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
 
         version_path.route(_desc.post("/message")).bind(&Self::createMessage, this)
@@ -275,18 +717,45 @@ struct MessagesService {
             .consumes(MIME(Application, Json))
             .parameter<Rest::Type::Integer>("id", "Id of the message.")
             .response(Http::Code::Ok, "You are OK")
+            .response(Http::Code::Not_Found, "No such message")
+            .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
+
+        version_path.route(_desc.patch("/message/:id")).bind(&Self::patchMessage, this)
+            .produces(MIME(Text, Plain))
+            .consumes(MIME(Application, Json))
+            .parameter<Rest::Type::Integer>("id", "Id of the message.")
+            .response(Http::Code::Ok, "You are OK")
+            .response(Http::Code::Not_Found, "No such message")
+            .response(Http::Code::Bad_Request, "Malformed merge patch")
+            .response(Http::Code::Unsupported_Media_Type, "Patch isn't JSON")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
 
         version_path.route(_desc.del("/message/:id")).bind(&Self::deleteMessage, this)
             .produces(MIME(Text, Plain))
             .parameter<Rest::Type::Integer>("id", "Id of the message.")
             .response(Http::Code::Ok, "You are OK")
+            .response(Http::Code::Not_Found, "No such message")
             .response(Http::Code::Internal_Server_Error, "You are NOT OK!!!");
     }
 };
 int main(int argc, char** argv) {
+    CLI::App app("Messages service");
+    uint16_t port = 8080;
+    common::ServingOptions serving;
+    common::CompressionOptions compression;
+    std::string export_directory = "export";
+    common::ChangeFeedOptions changes;
+    app.add_option("port", port, "Server port.");
+    app.add_option("--compress-threshold", compression.threshold, "Responses above this many bytes are compressed if client accepts it.");
+    app.add_option("--export-dir", export_directory, "Directory for the pre-serialized export of all messages.");
+    app.add_option("--publish-changes-to", changes.publish_to, "Pub/Sub service every change of messages is published to, eg. localhost:9080.");
+    app.add_option("--changes-topic", changes.topic, "Topic changes are published on.");
+    common::addServingOptions(app, serving);
+
+    CLI11_PARSE(app, argc, argv);
+
     try {
-        MessagesService service(argc <= 1 ? 8080 : std::strtoll(argv[1], NULL, 10), 1);
+        MessagesService service(port, serving, compression, export_directory, changes);
         service.run();
     } catch (const std::exception &e) {
         spdlog::error(e.what());
@@ -0,0 +1,30 @@
+#ifndef LAB11_MESSAGE_H
+#define LAB11_MESSAGE_H
+
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace ns {
+    struct Message {
+        std::string author;
+        uint id;
+        std::string contents;
+    };
+
+    inline void to_json(nlohmann::json& j, const Message& m) {
+        j = nlohmann::json{
+            {"author", m.author},
+            {"id", m.id},
+            {"contents", m.contents}
+        };
+    }
+    inline void from_json(const nlohmann::json& j, Message& m) {
+        j.at("author").get_to(m.author);
+        j.at("id").get_to(m.id);
+        j.at("contents").get_to(m.contents);
+    }
+}
+
+#endif
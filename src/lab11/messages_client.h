@@ -0,0 +1,109 @@
+#ifndef LAB11_MESSAGES_CLIENT_H
+#define LAB11_MESSAGES_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "common/api_client.h"
+#include "message.h"
+
+// Typed client of the Messages API. Cheap to create, all of them share the
+// process' connection pool unless given their own.
+struct MessagesClient {
+    using Message = ns::Message;
+    template<typename T>
+    using Promise = common::ApiClient::Promise<T>;
+    using Method = Pistache::Http::Method;
+
+    struct SearchHit {
+        std::size_t id;
+        double score;
+        Message message;
+    };
+
+    // Eg. "localhost:8080".
+    std::string _base;
+    common::ApiClient _http;
+
+    explicit MessagesClient(const std::string& host, common::ApiClient http = common::ApiClient::shared())
+        : _base(fmt::format("{}/v1", host)),
+          _http(std::move(http)) {}
+
+    Promise<std::vector<Message>> messages() const {
+        return _http.json<std::vector<Message>>(Method::Get, _base + "/messages");
+    }
+    Promise<std::vector<Message>> containing(std::string_view query) const {
+        return _http.json<std::vector<Message>>(Method::Get, fmt::format("{}/messages?contains={}", _base, common::urlEncode(query)));
+    }
+    Promise<std::vector<Message>> startingWith(std::string_view query) const {
+        return list(_http.text(Method::Get, fmt::format("{}/messages/{}", _base, common::urlEncode(query))));
+    }
+    Promise<std::vector<Message>> matching(const Message& message) const {
+        return list(_http.text(Method::Post, _base + "/messages", nlohmann::json(message).dump()));
+    }
+    Promise<std::vector<SearchHit>> search(std::string_view query, std::size_t limit = 20) const {
+        return _http.json<nlohmann::json>(
+            Method::Get, fmt::format("{}/search?q={}&limit={}", _base, common::urlEncode(query), limit)
+        ).then(
+            [](const nlohmann::json& hits) {
+                std::vector<SearchHit> result;
+                for (const auto& hit : hits) {
+                    result.push_back({
+                        hit.at("id").template get<std::size_t>(),
+                        hit.at("score").template get<double>(),
+                        hit.at("message").template get<Message>()
+                    });
+                }
+                return result;
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    Promise<Message> message(std::size_t id) const {
+        return _http.json<Message>(Method::Get, fmt::format("{}/message/{}", _base, id));
+    }
+    Promise<std::string> create(const Message& message) const {
+        return _http.text(Method::Post, _base + "/message", nlohmann::json(message).dump());
+    }
+    Promise<std::string> update(std::size_t id, const Message& message) const {
+        return _http.text(Method::Put, fmt::format("{}/message/{}", _base, id), nlohmann::json(message).dump());
+    }
+    // Merge patch, only fields present in it change.
+    Promise<std::string> patch(std::size_t id, const nlohmann::json& patch) const {
+        return _http.text(Method::Patch, fmt::format("{}/message/{}", _base, id), patch.dump());
+    }
+    // Bulk copy between environments, export of one service is import of another.
+    Promise<std::string> exportNdjson() const {
+        return _http.text(Method::Get, _base + "/messages/export");
+    }
+    Promise<nlohmann::json> importNdjson(std::string ndjson) const {
+        return _http.json<nlohmann::json>(Method::Post, _base + "/messages/import", std::move(ndjson));
+    }
+    // {"version", "changes"} after version `since`, continue with the returned version.
+    Promise<nlohmann::json> changes(uint64_t since, std::size_t limit = 1000) const {
+        return _http.json<nlohmann::json>(Method::Get, fmt::format("{}/changes?since={}&limit={}", _base, since, limit));
+    }
+    Promise<std::string> remove(std::size_t id) const {
+        return _http.text(Method::Delete, fmt::format("{}/message/{}", _base, id));
+    }
+
+private:
+    // Filters answer with plain text instead of an empty array when nothing matches.
+    static Promise<std::vector<Message>> list(Promise<std::string> text) {
+        return text.then(
+            [](const std::string& body) {
+                const auto json = nlohmann::json::parse(body, nullptr, false);
+                return json.is_array() ? json.template get<std::vector<Message>>() : std::vector<Message>{};
+            },
+            Pistache::Async::Throw
+        );
+    }
+};
+
+#endif
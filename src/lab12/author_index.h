@@ -0,0 +1,132 @@
+#ifndef LAB12_AUTHOR_INDEX_H
+#define LAB12_AUTHOR_INDEX_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+
+#include "common/row_slots.h"
+
+// Everything an author wrote, messages and comments, by author name.
+// References use ids given to messages when they're appended, their RowSlots
+// slots, rather than their positions, which shift on every erase. Ids grow in
+// store order, so sets of them iterate in store order too and a lookup costs
+// only what it returns. Once erased ids outnumber live ones they're renumbered.
+// Not synchronized, it's guarded together with the store it indexes.
+struct AuthorIndex {
+    struct CommentRef {
+        std::size_t message;
+        std::size_t comment;
+    };
+
+    struct Refs {
+        std::set<uint32_t> messages;
+        std::set<std::pair<uint32_t, uint32_t>> comments;
+    };
+
+    std::unordered_map<std::string, Refs> _authors;
+    // Message ids are slots.
+    common::RowSlots _ids;
+
+    template<typename Message>
+    void append(const Message& message) {
+        add(_ids.append(), message);
+    }
+
+    template<typename Message>
+    void replace(std::size_t position, const Message& old_message, const Message& message) {
+        const auto id = _ids.slot(position);
+        remove(id, old_message);
+        add(id, message);
+    }
+
+    template<typename Message>
+    void erase(std::size_t position, const Message& old_message) {
+        const auto id = _ids.slot(position);
+        remove(id, old_message);
+        _ids.erase(id);
+        if (_ids.tombstones() > 64 && _ids.tombstones() > _ids.size()) {
+            compact();
+        }
+    }
+
+    // Comment was appended as the comment-th one of the message at position.
+    void appendComment(std::size_t position, std::size_t comment, const std::string& author) {
+        _authors[author].comments.emplace(_ids.slot(position), static_cast<uint32_t>(comment));
+    }
+
+    // Positions of the author's messages, ascending.
+    std::vector<std::size_t> messages(const std::string& author) const {
+        std::vector<std::size_t> result;
+        if (const auto it = _authors.find(author); it != _authors.end()) {
+            result.reserve(it->second.messages.size());
+            for (const auto id : it->second.messages) {
+                result.push_back(_ids.position(id));
+            }
+        }
+        return result;
+    }
+
+    std::vector<CommentRef> comments(const std::string& author) const {
+        std::vector<CommentRef> result;
+        if (const auto it = _authors.find(author); it != _authors.end()) {
+            result.reserve(it->second.comments.size());
+            for (const auto& [id, comment] : it->second.comments) {
+                result.push_back({ _ids.position(id), comment });
+            }
+        }
+        return result;
+    }
+
+private:
+    // Renaming keeps the order, so the sets are rebuilt from sorted input in linear time.
+    void compact() {
+        const auto renamed = _ids.compact();
+        for (auto& [author, refs] : _authors) {
+            std::set<uint32_t> messages;
+            for (const auto id : refs.messages) {
+                messages.insert(messages.end(), renamed[id]);
+            }
+            std::set<std::pair<uint32_t, uint32_t>> comments;
+            for (const auto& [id, comment] : refs.comments) {
+                comments.insert(comments.end(), { renamed[id], comment });
+            }
+            refs.messages = std::move(messages);
+            refs.comments = std::move(comments);
+        }
+    }
+
+    template<typename Message>
+    void add(uint32_t id, const Message& message) {
+        _authors[message.author].messages.insert(id);
+        for (std::size_t i = 0; i < message.comments.size(); ++i) {
+            _authors[message.comments[i].author].comments.emplace(id, static_cast<uint32_t>(i));
+        }
+    }
+
+    template<typename Message>
+    void remove(uint32_t id, const Message& message) {
+        forget(message.author, [&](Refs& refs) { refs.messages.erase(id); });
+        for (std::size_t i = 0; i < message.comments.size(); ++i) {
+            forget(message.comments[i].author, [&](Refs& refs) { refs.comments.erase({ id, static_cast<uint32_t>(i) }); });
+        }
+    }
+
+    // Authors without anything left are dropped.
+    template<typename F>
+    void forget(const std::string& author, F&& f) {
+        const auto it = _authors.find(author);
+        if (it == _authors.end()) {
+            return;
+        }
+        f(it->second);
+        if (it->second.messages.empty() && it->second.comments.empty()) {
+            _authors.erase(it);
+        }
+    }
+};
+
+#endif
@@ -1,70 +1,108 @@
+#include <chrono>
+#include <string>
+#include <vector>
+#include <type_traits>
+
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
-#include <pistache/client.h>
+#include <nlohmann/json.hpp>
+
+#include "common/sync_wait.h"
+#include "messages_client.h"
 
 using namespace Pistache;
 
-std::atomic<bool> response_str_set = false;
-std::string response_str = "";
+constexpr auto response_timeout = std::chrono::seconds(5);
 
-void print(Async::Promise<Http::Response>&& response) {
+template<typename T>
+void print(Async::Promise<T>&& result) {
     try {
-        response.then(
-            [](const Http::Response& response) { response_str = response.body(); response_str_set = true; },
-            Async::Throw
-        );    
-    } catch (std::exception e) {
+        const auto value = common::waitFor(std::move(result), response_timeout);
+        if constexpr (std::is_same_v<T, std::string>) {
+            fmt::print("{}\n", value);
+        } else {
+            fmt::print("{}\n", nlohmann::json(value).dump(2));
+        }
+    } catch (const std::exception& e) {
         spdlog::error(e.what());
     }
 }
 
 int main(int argc, char** argv) {
-    const auto base_addr = fmt::format("localhost:{}/", argv[1]);
-
-    Http::Experimental::Client client{};
-
-    auto opts = Http::Experimental::Client::options().threads(1).maxConnectionsPerHost(8);
-    client.init(opts);
+    const MessagesClient client(fmt::format("localhost:{}", argv[1]), "test", "test");
 
-    std::string body = "{ \"author\": \"Eliasz\", \"id\": 4, \"contents\": \"Czesc\" }";
+    const ns::Message message{ "Eliasz", "Czesc", {{ "Eliasz", "Czesc" }} };
 
     switch (argv[2][0]) {
         // get messages
     case '0':
-        print(client.get(base_addr + "messages").send());
+        print(client.messages());
         break;
         // get message
     case '1':
-        print(client.get(base_addr + fmt::format("message/{}", argv[3])).send());
+        print(client.message(std::stoul(argv[3])));
         break;
         // post message
     case '2':
-        print(client.post(base_addr + "message").body(std::move(body)).send());
+        print(client.create(message));
         break;
         // put message
     case '3':
-        print(client.put(base_addr + fmt::format("message/{}", argv[3])).body(std::move(body)).send());
+        print(client.update(std::stoul(argv[3]), message));
         break;
         // del message
     case '4':
-        print(client.del(base_addr + fmt::format("message/{}", argv[3])).send());
+        print(client.remove(std::stoul(argv[3])));
         break;
         // query messages
     case '5':
-        print(client.get(base_addr + fmt::format("messages/{}", argv[3])).send());
+        print(client.startingWith(argv[3]));
         break;
         // get message's comments
     case '6':
-        print(client.get(base_addr + fmt::format("message/{}/comments", argv[3])).send());
+        print(client.comments(std::stoul(argv[3])));
+        break;
+        // full-text search
+    case '7':
+        try {
+            for (const auto& hit : common::waitFor(client.search(argv[3]), response_timeout)) {
+                fmt::print("{} {:.3f} {}\n", hit.id, hit.score, nlohmann::json(hit.message).dump());
+            }
+        } catch (const std::exception& e) {
+            spdlog::error(e.what());
+        }
+        break;
+        // author's messages and comments
+    case '8':
+        try {
+            // Both are in flight before waiting on either.
+            auto messages = client.authorMessages(argv[3]);
+            auto comments = client.authorComments(argv[3]);
+            for (const auto& m : common::waitFor(std::move(messages), response_timeout)) {
+                fmt::print("message {}: {}\n", m.id, m.message.contents);
+            }
+            for (const auto& c : common::waitFor(std::move(comments), response_timeout)) {
+                fmt::print("comment {}/{}: {}\n", c.message, c.comment, c.contents);
+            }
+        } catch (const std::exception& e) {
+            spdlog::error(e.what());
+        }
+        break;
+        // patch message with a merge patch
+    case '9':
+        print(client.patch(std::stoul(argv[3]), nlohmann::json::parse(argv[4])));
         break;
+        // get given messages at once
+    case 'b': {
+        std::vector<Async::Promise<ns::Message>> calls;
+        for (int i = 3; i < argc; ++i) {
+            calls.push_back(client.message(std::stoul(argv[i])));
+        }
+        print(common::ApiClient::all(std::move(calls)));
+        break;
+    }
     default:
         spdlog::error("No such option");
         break; 
     }
-    while (!response_str_set) {}
-
-    fmt::print("{}\n", response_str);
-
-    client.shutdown();
-
-}
\ No newline at end of file
+}
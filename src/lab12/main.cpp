@@ -3,6 +3,9 @@
 #include <string>
 #include <string_view>
 #include <algorithm>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
 
 #include <spdlog/spdlog.h>
 #include <fmt/format.h>
@@ -11,90 +14,306 @@
 #include <pistache/router.h>
 #include <pistache/mime.h>
 
+#include "common/versioned_cache.h"
+#include "common/encoded_response.h"
+#include "common/serving.h"
+#include "common/mvcc.h"
+#include "common/search_index.h"
+#include "common/substring_scan.h"
+#include "common/expected.h"
+#include "common/error_response.h"
+#include "common/ndjson.h"
+#include "common/export_file.h"
+#include "common/file_response.h"
+#include "common/change_log.h"
+#include "common/change_publisher.h"
+
+#include "author_index.h"
+
 using namespace Pistache;
 
 #include <nlohmann/json.hpp>
 using namespace nlohmann::literals;
 
-namespace ns {
-    struct Comment {
-        std::string author;
-        std::string contents;
-    };
-    struct Message {
-        std::string author;
-        std::string contents;
-        std::vector<Comment> comments;
-    };
-}
+#include "message.h"
 using Message = ns::Message;
 using Comment = ns::Comment;
 
-std::vector<Message> messages {
+// Readers work on snapshots, a long scan neither blocks nor is blocked by writes.
+common::MvccVector<Message> messages {
     { "Piotr", "Witaj", {{"Piotr", "Cześć"}, {"Piotr", "Cześć"}, {"Piotr", "Cześć"}}},    
     { "Jacek", "Witaj", {{"Jacek", "Cześć"}, {"Jacek", "Cześć"}, {"Jacek", "Cześć"}}},   
     { "Jarek", "Witaj", {{"Jarek", "Cześć"}, {"Jarek", "Cześć"}, {"Jarek", "Cześć"}}}    
 };
 
-const Message& dbGetMessage(std::size_t id) {
-    if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+// Words of a message the search index knows about, its own count twice as much as comments'.
+std::vector<common::SearchIndex::Field> searchFields(const Message& message) {
+    std::vector<common::SearchIndex::Field> fields{ { message.contents, 2 } };
+    for (const auto& comment : message.comments) {
+        fields.push_back({ comment.contents });
+    }
+    return fields;
+}
+// Full-text index over messages, kept up to date by the db* functions below.
+common::SearchIndex messages_index = [] {
+    common::SearchIndex index;
+    for (const auto& message : messages.snapshot()) {
+        index.append(searchFields(message));
+    }
+    return index;
+}();
+
+// Contents of all messages back to back, for substring scans no index helps with.
+common::StringColumn messages_contents = [] {
+    common::StringColumn column;
+    for (const auto& message : messages.snapshot()) {
+        column.append(message.contents);
+    }
+    return column;
+}();
+
+// Messages and comments by author, for activity pages.
+AuthorIndex messages_authors = [] {
+    AuthorIndex index;
+    for (const auto& message : messages.snapshot()) {
+        index.append(message);
+    }
+    return index;
+}();
+
+// Bumped by every modification, cached responses built from older version are stale.
+std::atomic<uint64_t> messages_version = 0;
+// Keeps the indexes in step with messages: writers own it, index lookups share
+// it. Reads of messages alone go to a snapshot without taking it.
+std::shared_mutex messages_mutex;
+
+// Missing ids are routine (scans, stale links), they're returned rather than thrown.
+const common::Error no_such_message{ common::Errc::NotFound, "No such message" };
+
+// Every write as it happened, for consumers keeping a copy of messages up to
+// date. Versions are those of messages' snapshots, the export's ETag among them.
+common::ChangeLog<Message> messages_changes;
+
+// Records the write just done to messages, writers call it holding messages_mutex.
+void recordChange(common::ChangeKind kind, std::size_t id, std::optional<Message> value = std::nullopt) {
+    messages_changes.record({ messages.version(), kind, id, std::move(value) });
+}
+
+common::Expected<Message> dbGetMessage(std::size_t id) {
+    const auto snapshot = messages.snapshot();
+    if (id >= snapshot.size()) {
+        return no_such_message;
     }
-    return messages[id];
+    return snapshot[id];
 }
 std::vector<Message> dbGetMessagesStartingWith(std::string_view query) {
     std::vector<Message> result;
-    for (const auto& message : messages) {
+    for (const auto& message : messages.snapshot()) {
         if (std::string_view(message.contents).substr(0, query.size()).compare(query.data()) == 0) {
             result.push_back(message);
         }
     }
     return result;
 }
-const std::vector<Message>& dbGetMessages() noexcept {
-    return messages;
+std::vector<Message> dbGetMessagesContaining(std::string_view query) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<Message> result;
+    for (const auto id : messages_contents.contains(query)) {
+        result.push_back(snapshot[id]);
+    }
+    return result;
 }
-void dbCreateMessage(const Message& message) {
-    messages.push_back(message);
+std::vector<std::pair<common::SearchIndex::Hit, Message>> dbSearchMessages(std::string_view query, std::size_t limit) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<std::pair<common::SearchIndex::Hit, Message>> result;
+    for (const auto& hit : messages_index.search(query, limit)) {
+        result.emplace_back(hit, snapshot[hit.position]);
+    }
+    return result;
 }
-void dbUpdateMessage(const Message& message, std::size_t id) {
+std::vector<std::pair<std::size_t, Message>> dbGetAuthorMessages(const std::string& author) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<std::pair<std::size_t, Message>> result;
+    for (const auto id : messages_authors.messages(author)) {
+        result.emplace_back(id, snapshot[id]);
+    }
+    return result;
+}
+std::vector<std::pair<AuthorIndex::CommentRef, Comment>> dbGetAuthorComments(const std::string& author) {
+    std::shared_lock lock(messages_mutex);
+    const auto snapshot = messages.snapshot();
+    std::vector<std::pair<AuthorIndex::CommentRef, Comment>> result;
+    for (const auto& ref : messages_authors.comments(author)) {
+        result.emplace_back(ref, snapshot[ref.message].comments[ref.comment]);
+    }
+    return result;
+}
+// Serializing straight from the snapshot, nothing is copied and writes go on meanwhile.
+common::MvccVector<Message>::Snapshot dbGetMessages() {
+    return messages.snapshot();
+}
+std::size_t dbCreateMessage(const Message& message) {
+    std::unique_lock lock(messages_mutex);
+    const auto id = messages.push_back(message);
+    recordChange(common::ChangeKind::Create, id, message);
+    messages_index.append(searchFields(message));
+    messages_contents.append(message.contents);
+    messages_authors.append(message);
+    ++messages_version;
+    return id;
+}
+// Whole batch under one lock and in a single version, readers see all of it or none.
+// An empty one writes nothing, a version without changes would be a gap in the feed.
+std::size_t dbImportMessages(std::vector<Message> imported) {
+    std::unique_lock lock(messages_mutex);
+    if (imported.empty()) {
+        return messages.size();
+    }
+    for (const auto& message : imported) {
+        messages_index.append(searchFields(message));
+        messages_contents.append(message.contents);
+        messages_authors.append(message);
+    }
+    const auto first = messages.append_range(std::move(imported));
+    const auto version = messages.version();
+    const auto size = messages.size();
+    std::vector<common::Change<Message>> changes;
+    changes.reserve(size - first);
+    for (auto id = first; id < size; ++id) {
+        changes.push_back({ version, common::ChangeKind::Create, id, *messages.latest(id) });
+    }
+    messages_changes.record(std::move(changes));
+    ++messages_version;
+    return first;
+}
+common::Expected<std::size_t> dbAppendComment(const Comment& comment, std::size_t id) {
+    std::unique_lock lock(messages_mutex);
     if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+        return no_such_message;
     }
-    messages[id] = message;
+    const auto position = messages.update(id, [&](Message& message) {
+        message.comments = message.comments.appended(comment);
+        return message.comments.size() - 1;
+    });
+    const auto stored = messages.latest(id);
+    // Weighted as searchFields() does, the rest of the message stays indexed as it is.
+    messages_index.extend(id, { { comment.contents } });
+    messages_authors.appendComment(id, position, comment.author);
+    recordChange(common::ChangeKind::Update, id, *stored);
+    ++messages_version;
+    return position;
 }
-void dbDeleteMessage(std::size_t id) {
+common::Expected<void> dbUpdateMessage(const Message& message, std::size_t id) {
+    std::unique_lock lock(messages_mutex);
     if (id >= messages.size()) {
-        throw std::runtime_error(fmt::format("No such message with id {}", id));
+        return no_such_message;
+    }
+    const auto stored = messages.latest(id);
+    messages_authors.replace(id, *stored, message);
+    messages.set(id, message);
+    recordChange(common::ChangeKind::Update, id, message);
+    messages_index.replace(id, searchFields(message));
+    messages_contents.replace(id, message.contents);
+    ++messages_version;
+    return {};
+}
+common::Expected<void> dbDeleteMessage(std::size_t id) {
+    std::unique_lock lock(messages_mutex);
+    if (id >= messages.size()) {
+        return no_such_message;
+    }
+    const auto stored = messages.latest(id);
+    messages_authors.erase(id, *stored);
+    messages.erase(id);
+    recordChange(common::ChangeKind::Delete, id);
+    messages_index.erase(id);
+    messages_contents.erase(id);
+    ++messages_version;
+    return {};
+}
+
+// Fields a merge patch actually changed, anything else keeps its cache and index entries.
+struct MessageChanges {
+    bool author = false;
+    bool contents = false;
+    bool comments = false;
+
+    bool any() const noexcept {
+        return author || contents || comments;
+    }
+};
+
+// Replaces field with value unless they're equal, returns whether it did.
+template<typename T>
+bool patchField(T& field, const nlohmann::json& value) {
+    auto patched = value.get<T>();
+    if (patched == field) {
+        return false;
+    }
+    field = std::move(patched);
+    return true;
+}
+
+// RFC 7396 merge patch of a message. Every field is required, so none can be
+// removed with null, and there are no nested objects to merge into.
+common::Expected<MessageChanges> applyPatch(Message& message, const nlohmann::json& patch) {
+    if (!patch.is_object()) {
+        return common::Error{ common::Errc::BadRequest, "Merge patch of a message has to be an object" };
     }
-    messages.erase(std::next(messages.begin(), id));
+    MessageChanges changes;
+    for (const auto& [key, value] : patch.items()) {
+        if (value.is_null()) {
+            return common::Error{ common::Errc::BadRequest, fmt::format("Field {} can't be removed", key) };
+        }
+        if (key == "author") {
+            changes.author = patchField(message.author, value);
+        } else if (key == "contents") {
+            changes.contents = patchField(message.contents, value);
+        } else if (key == "comments") {
+            // Arrays aren't merged, a patch replaces them whole.
+            changes.comments = patchField(message.comments, value);
+        } else {
+            return common::Error{ common::Errc::BadRequest, fmt::format("Unknown field {}", key) };
+        }
+    }
+    return changes;
 }
 
-namespace ns {
-    void to_json(nlohmann::json& j, const Comment& c) {
-        j = nlohmann::json{
-            {"author", c.author},
-            {"contents", c.contents}
-        };
-    }
-    void from_json(const nlohmann::json& j, Comment& c) {
-        j.at("author").get_to(c.author);
-        j.at("contents").get_to(c.contents);
-    }
-    void to_json(nlohmann::json& j, const Message& m) {
-        j = nlohmann::json{
-            {"author", m.author},
-            {"contents", m.contents},
-            {"comments", m.comments}
-        };
-    }
-    void from_json(const nlohmann::json& j, Message& m) {
-        j.at("author").get_to(m.author);
-        j.at("contents").get_to(m.contents);
-        j.at("comments").get_to(m.comments);
+// Patched copy replaces the stored message, sharing its comments unless the
+// patch replaces them. Only indexes over changed fields are touched and a
+// patch changing nothing leaves cached responses valid.
+common::Expected<MessageChanges> dbPatchMessage(const nlohmann::json& patch, std::size_t id) {
+    std::unique_lock lock(messages_mutex);
+    if (id >= messages.size()) {
+        return no_such_message;
+    }
+    const auto stored = messages.latest(id);
+    auto message = *stored;
+    const auto patched = applyPatch(message, patch);
+    if (!patched || !patched->any()) {
+        return patched;
+    }
+    const auto& changes = *patched;
+    if (changes.contents || changes.comments) {
+        messages_index.replace(id, searchFields(message));
     }
+    if (changes.contents) {
+        messages_contents.replace(id, message.contents);
+    }
+    if (changes.author || changes.comments) {
+        messages_authors.replace(id, *stored, message);
+    }
+    messages.set(id, message);
+    recordChange(common::ChangeKind::Update, id, std::move(message));
+    ++messages_version;
+    return patched;
 }
-auto toJSON(const std::vector<Message>& messages) {
+
+template<typename Messages>
+auto toJSON(const Messages& messages) {
     nlohmann::json result;
     for (const auto& m : messages) {
         nlohmann::json j = m;
@@ -102,6 +321,31 @@ auto toJSON(const std::vector<Message>& messages) {
     }
     return result.dump();
 }
+auto toJSON(const std::vector<std::pair<common::SearchIndex::Hit, Message>>& hits) {
+    nlohmann::json result = nlohmann::json::array();
+    for (const auto& [hit, m] : hits) {
+        result.push_back({
+            {"id", hit.position},
+            {"score", hit.score},
+            {"message", m}
+        });
+    }
+    return result.dump();
+}
+
+// User whose basic credentials check out, the same ones the middleware lets in.
+// Admission control charges requests to it instead of to the address.
+std::optional<std::string> authenticatedUser(const Http::Request& request) {
+    const auto auth_header = request.headers().tryGet<Http::Header::Authorization>();
+    if (!auth_header || !auth_header->hasMethod<Http::Header::Authorization::Method::Basic>()) {
+        return std::nullopt;
+    }
+    auto user = auth_header->getBasicUser();
+    if (user != "test" || auth_header->getBasicPassword() != "test") {
+        return std::nullopt;
+    }
+    return user;
+}
 
 struct SpdlogStringLogger : Log::StringLogger {
     void log(Log::Level level, const std::string& message) {
@@ -123,17 +367,49 @@ struct MessagesService {
     using Self = MessagesService;
 
     uint16_t _port;
-    uint _num_threads;
+    common::ServingOptions _serving;
     Address _address{ "localhost", _port };
-    std::shared_ptr<Http::Endpoint> _end_point{ std::make_shared<Http::Endpoint>(_address) };
+    common::Endpoints _end_points{ _address, _serving };
     Rest::Router _router;
+    common::VersionedCache<std::string> _responses;
+    common::ExportFile<Message> _export;
+    std::unique_ptr<common::ChangePublisher<Message>> _changes_publisher;
 
-    MessagesService(uint16_t port, uint num_threads = std::thread::hardware_concurrency())
+    MessagesService(uint16_t port,
+                    common::ServingOptions serving = {},
+                    common::CompressionOptions compression = {},
+                    std::filesystem::path export_directory = "export",
+                    common::ChangeFeedOptions changes = {})
         : _port(port),
-          _num_threads(num_threads) {}
+          _serving(serving),
+          _responses(compression),
+          _export(std::move(export_directory), "messages") {
+        if (!changes.publish_to.empty()) {
+            _changes_publisher = std::make_unique<common::ChangePublisher<Message>>(
+                changes.publish_to, changes.topic, "messages"
+            );
+            messages_changes.listen([publisher = _changes_publisher.get()](const auto& changes) {
+                publisher->publish(changes);
+            });
+        }
+    }
 
     void getMessages(const Rest::Request& request, Http::ResponseWriter response) {
-        response.send(Http::Code::Ok, toJSON(messages), MIME(Application, Json));
+        try {
+            const auto contains = request.query().get("contains");
+            const auto body = contains
+                ? _responses.get(fmt::format("contains/{}", *contains), messages_version, [&] {
+                      return toJSON(dbGetMessagesContaining(*contains));
+                  })
+                : _responses.get("messages", messages_version, [] { return toJSON(dbGetMessages()); });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
     }
     void findMessages(const Rest::Request& request, Http::ResponseWriter response) {
         try {
@@ -151,11 +427,43 @@ struct MessagesService {
             );
         }
     }
+    void searchMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto query = request.query().get("q");
+            if (!query || query->empty()) {
+                response.send(Http::Code::Bad_Request, "Missing q parameter", MIME(Text, Plain));
+                return;
+            }
+            const auto limit = common::numberQuery(request, "limit", 20);
+            if (!limit) {
+                common::sendError(response, limit.error());
+                return;
+            }
+            const auto body = _responses.get(fmt::format("search/{}/{}", *limit, *query), messages_version, [&] {
+                return toJSON(dbSearchMessages(*query, *limit));
+            });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
     void getMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            const auto& m = dbGetMessage(id);
-            nlohmann::json j = m;
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            const auto m = dbGetMessage(*id);
+            if (!m) {
+                common::sendError(response, m.error());
+                return;
+            }
+            nlohmann::json j = *m;
             response.send(Http::Code::Ok, j.dump(), MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
@@ -167,10 +475,68 @@ struct MessagesService {
     }
     void getMessageComments(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            const auto& m = dbGetMessage(id);
-            nlohmann::json j = m.comments;
-            response.send(Http::Code::Ok, j.dump(), MIME(Application, Json));
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            // Read before the message, so what's cached is never older than the version it's cached under.
+            const uint64_t version = messages_version;
+            const auto m = dbGetMessage(*id);
+            if (!m) {
+                common::sendError(response, m.error());
+                return;
+            }
+            const auto body = _responses.get(fmt::format("comments/{}", *id), version, [&m] {
+                nlohmann::json j = m->comments;
+                return j.dump();
+            });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void getAuthorMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto author = request.param(":name").as<std::string>();
+            const auto body = _responses.get(fmt::format("authors/{}/messages", author), messages_version, [&] {
+                nlohmann::json result = nlohmann::json::array();
+                for (const auto& [id, m] : dbGetAuthorMessages(author)) {
+                    result.push_back({
+                        {"id", id},
+                        {"message", m}
+                    });
+                }
+                return result.dump();
+            });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void getAuthorComments(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto author = request.param(":name").as<std::string>();
+            const auto body = _responses.get(fmt::format("authors/{}/comments", author), messages_version, [&] {
+                nlohmann::json result = nlohmann::json::array();
+                for (const auto& [ref, c] : dbGetAuthorComments(author)) {
+                    result.push_back({
+                        {"message", ref.message},
+                        {"comment", ref.comment},
+                        {"contents", c.contents}
+                    });
+                }
+                return result.dump();
+            });
+            common::sendEncoded(request, response, Http::Code::Ok, *body, MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -181,16 +547,57 @@ struct MessagesService {
     }
     void createMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            if (request.headers().has("/json")) {
-                throw std::runtime_error(
-                    fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString())
-                );
+            if (const auto json = common::requireJson(request); !json) {
+                common::sendError(response, json.error());
+                return;
             }
-            dbCreateMessage(nlohmann::json::parse(request.body()).template get<Message>());
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            const auto id = dbCreateMessage(body->template get<Message>());
             response.headers().add<Http::Header::Location>(
-                fmt::format("localhost:{}/message/{}", _address.port().toString(), messages.size()-1UL)
+                fmt::format("localhost:{}/message/{}", _address.port().toString(), id)
             );
             response.send(Http::Code::Ok, "Message has been succesfully created!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void appendComment(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto json = common::requireJson(request); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            const auto comment = dbAppendComment(body->template get<Comment>(), *id);
+            if (!comment) {
+                common::sendError(response, comment.error());
+                return;
+            }
+            response.headers().add<Http::Header::Location>(
+                fmt::format("localhost:{}/message/{}/comments/{}", _address.port().toString(), *id, *comment)
+            );
+            response.send(Http::Code::Ok, "Comment has been succesfully added!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -201,14 +608,152 @@ struct MessagesService {
     }
     void updateMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            if (request.headers().has("/json")) {
-                throw std::runtime_error(
-                    fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString())
-                );
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto json = common::requireJson(request); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto body = common::jsonBody(request);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            if (const auto updated = dbUpdateMessage(body->template get<Message>(), *id); !updated) {
+                common::sendError(response, updated.error());
+                return;
             }
-            dbUpdateMessage(nlohmann::json::parse(request.body()).template get<Message>(), id);
             response.send(Http::Code::Ok, "Message has been succesfully updated!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void patchMessage(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto json = common::requireJson(request, "application/merge-patch+json"); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto patch = common::jsonBody(request);
+            if (!patch) {
+                common::sendError(response, patch.error());
+                return;
+            }
+            if (const auto patched = dbPatchMessage(*patch, *id); !patched) {
+                common::sendError(response, patched.error());
+                return;
+            }
+            response.send(Http::Code::Ok, "Message has been succesfully patched!");
+        } catch (const nlohmann::json::exception& e) {
+            common::sendError(response, { common::Errc::BadRequest, e.what() });
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // One message per line, lines are parsed in parallel and stored only if all of them are valid.
+    void importMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            if (const auto json = common::requireJson(request, "application/x-ndjson"); !json) {
+                common::sendError(response, json.error());
+                return;
+            }
+            const auto body = common::decodedBody(request, _serving.max_request_bytes);
+            if (!body) {
+                common::sendError(response, body.error());
+                return;
+            }
+            auto imported = common::parseNdjson<Message>(*body);
+            if (!imported) {
+                common::sendError(response, imported.error());
+                return;
+            }
+            const auto count = imported->size();
+            const auto first = dbImportMessages(std::move(*imported));
+            const nlohmann::json result{
+                {"imported", count},
+                {"first_id", first}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Snapshot taken up front, writes going on meanwhile don't show up half way through.
+    void exportMessages(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            common::streamNdjson(response, dbGetMessages());
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Pre-serialized JSON array, rewritten from the first chunk changed since the
+    // last export and sent with sendfile. Resumable through Range.
+    void exportMessagesFile(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto file = _export.update(dbGetMessages());
+            common::sendFile(
+                request, response,
+                file->path.string(), file->size,
+                MIME(Application, Json),
+                fmt::format("\"{}\"", file->version)
+            );
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    // Changes after `since`, oldest first, and the version to ask for the next ones after.
+    void getChanges(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto since = common::numberQuery(request, "since");
+            if (!since) {
+                common::sendError(response, since.error());
+                return;
+            }
+            const auto limit = common::numberQuery(request, "limit", 1000);
+            if (!limit) {
+                common::sendError(response, limit.error());
+                return;
+            }
+            const auto page = messages_changes.since(*since, *limit, messages.version());
+            if (!page) {
+                common::sendError(response, page.error());
+                return;
+            }
+            const nlohmann::json result{
+                {"version", page->version},
+                {"changes", page->changes}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -219,8 +764,15 @@ struct MessagesService {
     }
     void deleteMessage(const Rest::Request& request, Http::ResponseWriter response) {
         try {
-            const auto id = request.param(":id").as<std::size_t>();
-            dbDeleteMessage(id);
+            const auto id = common::idParam(request, ":id");
+            if (!id) {
+                common::sendError(response, id.error());
+                return;
+            }
+            if (const auto deleted = dbDeleteMessage(*id); !deleted) {
+                common::sendError(response, deleted.error());
+                return;
+            }
             response.send(Http::Code::Ok, "Message has been succesfully deleted!");
         } catch (const std::exception& e) {
             response.send(
@@ -232,9 +784,10 @@ struct MessagesService {
     }
 
     void run() {
-        spdlog::info("Server started on port {} with {} threads", _port, _num_threads);
+        spdlog::info("Server started on port {} with {} listeners of {} threads", _port, _serving.listeners, _serving.threads);
+        spdlog::info("Substring scans use {}", common::findImplementation());
 
-        _end_point->init(Http::Endpoint::options().threads(_num_threads).logger(std::make_shared<SpdlogStringLogger>()));
+        _end_points.init(Http::Endpoint::options().logger(std::make_shared<SpdlogStringLogger>()));
 
         _router.addMiddleware(+[](Http::Request& request, Http::ResponseWriter& writer) -> bool {
             const auto auth_header = request.headers().get<Http::Header::Authorization>();
@@ -249,21 +802,45 @@ struct MessagesService {
             return true;
         });
         Rest::Routes::Get(_router, "/messages", Rest::Routes::bind(&Self::getMessages, this));
+        Rest::Routes::Get(_router, "/messages/export", Rest::Routes::bind(&Self::exportMessages, this));
+        Rest::Routes::Get(_router, "/messages/export.json", Rest::Routes::bind(&Self::exportMessagesFile, this));
+        Rest::Routes::Post(_router, "/messages/import", Rest::Routes::bind(&Self::importMessages, this));
         Rest::Routes::Get(_router, "/messages/:startswith", Rest::Routes::bind(&Self::findMessages, this));
+        Rest::Routes::Get(_router, "/changes", Rest::Routes::bind(&Self::getChanges, this));
+        Rest::Routes::Get(_router, "/search", Rest::Routes::bind(&Self::searchMessages, this));
         Rest::Routes::Get(_router, "/message/:id", Rest::Routes::bind(&Self::getMessage, this));
         Rest::Routes::Get(_router, "/message/:id/comments", Rest::Routes::bind(&Self::getMessageComments, this));
+        Rest::Routes::Post(_router, "/message/:id/comments", Rest::Routes::bind(&Self::appendComment, this));
+        Rest::Routes::Get(_router, "/authors/:name/messages", Rest::Routes::bind(&Self::getAuthorMessages, this));
+        Rest::Routes::Get(_router, "/authors/:name/comments", Rest::Routes::bind(&Self::getAuthorComments, this));
         Rest::Routes::Post(_router, "/message", Rest::Routes::bind(&Self::createMessage, this));
         Rest::Routes::Put(_router, "/message/:id", Rest::Routes::bind(&Self::updateMessage, this));
+        Rest::Routes::Patch(_router, "/message/:id", Rest::Routes::bind(&Self::patchMessage, this));
         Rest::Routes::Delete(_router, "/message/:id", Rest::Routes::bind(&Self::deleteMessage, this));
 
-        _end_point->setHandler(_router.handler());
+        _end_points.setHandler(_router.handler(), authenticatedUser);
 
-        _end_point->serve();
+        _end_points.serve();
     }
 };
 int main(int argc, char** argv) {
+    CLI::App app("Messages service");
+    uint16_t port = 8080;
+    common::ServingOptions serving;
+    common::CompressionOptions compression;
+    std::string export_directory = "export";
+    common::ChangeFeedOptions changes;
+    app.add_option("port", port, "Server port.");
+    app.add_option("--compress-threshold", compression.threshold, "Responses above this many bytes are compressed if client accepts it.");
+    app.add_option("--export-dir", export_directory, "Directory for the pre-serialized export of all messages.");
+    app.add_option("--publish-changes-to", changes.publish_to, "Pub/Sub service every change of messages is published to, eg. localhost:9080.");
+    app.add_option("--changes-topic", changes.topic, "Topic changes are published on.");
+    common::addServingOptions(app, serving);
+
+    CLI11_PARSE(app, argc, argv);
+
     try {
-        MessagesService service(argc <= 1 ? 8080 : std::strtoll(argv[1], NULL, 10), 1);
+        MessagesService service(port, serving, compression, export_directory, changes);
         service.run();
     }
     catch (const std::exception &e) {
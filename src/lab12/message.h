@@ -0,0 +1,95 @@
+#ifndef LAB12_MESSAGE_H
+#define LAB12_MESSAGE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <initializer_list>
+
+#include <nlohmann/json.hpp>
+
+namespace ns {
+    struct Comment {
+        std::string author;
+        std::string contents;
+
+        bool operator==(const Comment&) const = default;
+    };
+    // Comments of a message, immutable and shared by its versions: a write to
+    // anything else of the message copies the pointer, not the comments.
+    class Comments {
+    public:
+        Comments() : _comments(std::make_shared<const std::vector<Comment>>()) {}
+        Comments(std::vector<Comment> comments)
+            : _comments(std::make_shared<const std::vector<Comment>>(std::move(comments))) {}
+        Comments(std::initializer_list<Comment> comments) : Comments(std::vector<Comment>(comments)) {}
+
+        const std::vector<Comment>& operator*() const noexcept {
+            return *_comments;
+        }
+        std::size_t size() const noexcept {
+            return _comments->size();
+        }
+        const Comment& operator[](std::size_t i) const {
+            return (*_comments)[i];
+        }
+        auto begin() const noexcept {
+            return _comments->begin();
+        }
+        auto end() const noexcept {
+            return _comments->end();
+        }
+
+        // This one's comments and comment after them, this one stays as it is.
+        Comments appended(Comment comment) const {
+            std::vector<Comment> comments;
+            comments.reserve(size() + 1);
+            comments = *_comments;
+            comments.push_back(std::move(comment));
+            return comments;
+        }
+
+        bool operator==(const Comments& other) const {
+            return _comments == other._comments || *_comments == *other._comments;
+        }
+
+    private:
+        std::shared_ptr<const std::vector<Comment>> _comments;
+    };
+    struct Message {
+        std::string author;
+        std::string contents;
+        Comments comments;
+    };
+
+    inline void to_json(nlohmann::json& j, const Comment& c) {
+        j = nlohmann::json{
+            {"author", c.author},
+            {"contents", c.contents}
+        };
+    }
+    inline void from_json(const nlohmann::json& j, Comment& c) {
+        j.at("author").get_to(c.author);
+        j.at("contents").get_to(c.contents);
+    }
+    inline void to_json(nlohmann::json& j, const Comments& c) {
+        j = *c;
+    }
+    inline void from_json(const nlohmann::json& j, Comments& c) {
+        c = j.get<std::vector<Comment>>();
+    }
+    inline void to_json(nlohmann::json& j, const Message& m) {
+        j = nlohmann::json{
+            {"author", m.author},
+            {"contents", m.contents},
+            {"comments", m.comments}
+        };
+    }
+    inline void from_json(const nlohmann::json& j, Message& m) {
+        j.at("author").get_to(m.author);
+        j.at("contents").get_to(m.contents);
+        j.at("comments").get_to(m.comments);
+    }
+}
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef LAB12_MESSAGES_CLIENT_H
+#define LAB12_MESSAGES_CLIENT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "common/api_client.h"
+#include "message.h"
+
+// Typed client of the Messages API with comments. Cheap to create, all of
+// them share the process' connection pool unless given their own.
+struct MessagesClient {
+    using Message = ns::Message;
+    using Comment = ns::Comment;
+    template<typename T>
+    using Promise = common::ApiClient::Promise<T>;
+    using Method = Pistache::Http::Method;
+
+    struct SearchHit {
+        std::size_t id;
+        double score;
+        Message message;
+    };
+    struct AuthorMessage {
+        std::size_t id;
+        Message message;
+    };
+    struct AuthorComment {
+        std::size_t message;
+        std::size_t comment;
+        std::string contents;
+    };
+
+    // Eg. "localhost:8080".
+    std::string _base;
+    common::ApiClient _http;
+    // Service wants basic auth on every request.
+    common::ApiClient::Headers _headers;
+
+    MessagesClient(std::string host, const std::string& user, const std::string& password,
+        common::ApiClient http = common::ApiClient::shared())
+        : _base(std::move(host)),
+          _http(std::move(http)) {
+        auto authorization = std::make_shared<Pistache::Http::Header::Authorization>();
+        authorization->setBasicUserPassword(user, password);
+        _headers.push_back(std::move(authorization));
+    }
+
+    Promise<std::vector<Message>> messages() const {
+        return _http.json<std::vector<Message>>(Method::Get, _base + "/messages", {}, _headers);
+    }
+    Promise<std::vector<Message>> containing(std::string_view query) const {
+        return _http.json<std::vector<Message>>(
+            Method::Get, fmt::format("{}/messages?contains={}", _base, common::urlEncode(query)), {}, _headers
+        );
+    }
+    Promise<std::vector<Message>> startingWith(std::string_view query) const {
+        return _http.text(Method::Get, fmt::format("{}/messages/{}", _base, common::urlEncode(query)), {}, _headers).then(
+            [](const std::string& body) {
+                // Plain text instead of an empty array when nothing matches.
+                const auto json = nlohmann::json::parse(body, nullptr, false);
+                return json.is_array() ? json.template get<std::vector<Message>>() : std::vector<Message>{};
+            },
+            Pistache::Async::Throw
+        );
+    }
+    Promise<std::vector<SearchHit>> search(std::string_view query, std::size_t limit = 20) const {
+        return _http.json<nlohmann::json>(
+            Method::Get, fmt::format("{}/search?q={}&limit={}", _base, common::urlEncode(query), limit), {}, _headers
+        ).then(
+            [](const nlohmann::json& hits) {
+                std::vector<SearchHit> result;
+                for (const auto& hit : hits) {
+                    result.push_back({
+                        hit.at("id").template get<std::size_t>(),
+                        hit.at("score").template get<double>(),
+                        hit.at("message").template get<Message>()
+                    });
+                }
+                return result;
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    Promise<Message> message(std::size_t id) const {
+        return _http.json<Message>(Method::Get, fmt::format("{}/message/{}", _base, id), {}, _headers);
+    }
+    Promise<std::vector<Comment>> comments(std::size_t id) const {
+        return _http.json<std::vector<Comment>>(Method::Get, fmt::format("{}/message/{}/comments", _base, id), {}, _headers);
+    }
+    Promise<std::string> create(const Message& message) const {
+        return _http.text(Method::Post, _base + "/message", nlohmann::json(message).dump(), _headers);
+    }
+    Promise<std::string> comment(std::size_t id, const Comment& comment) const {
+        return _http.text(Method::Post, fmt::format("{}/message/{}/comments", _base, id), nlohmann::json(comment).dump(), _headers);
+    }
+    Promise<std::string> update(std::size_t id, const Message& message) const {
+        return _http.text(Method::Put, fmt::format("{}/message/{}", _base, id), nlohmann::json(message).dump(), _headers);
+    }
+    // Merge patch, only fields present in it change, comments are replaced whole.
+    Promise<std::string> patch(std::size_t id, const nlohmann::json& patch) const {
+        return _http.text(Method::Patch, fmt::format("{}/message/{}", _base, id), patch.dump(), _headers);
+    }
+    // Bulk copy between environments, export of one service is import of another.
+    Promise<std::string> exportNdjson() const {
+        return _http.text(Method::Get, _base + "/messages/export", {}, _headers);
+    }
+    Promise<nlohmann::json> importNdjson(std::string ndjson) const {
+        return _http.json<nlohmann::json>(Method::Post, _base + "/messages/import", std::move(ndjson), _headers);
+    }
+    // {"version", "changes"} after version `since`, continue with the returned version.
+    Promise<nlohmann::json> changes(uint64_t since, std::size_t limit = 1000) const {
+        return _http.json<nlohmann::json>(Method::Get, fmt::format("{}/changes?since={}&limit={}", _base, since, limit), {}, _headers);
+    }
+    Promise<std::string> remove(std::size_t id) const {
+        return _http.text(Method::Delete, fmt::format("{}/message/{}", _base, id), {}, _headers);
+    }
+
+    Promise<std::vector<AuthorMessage>> authorMessages(std::string_view author) const {
+        return _http.json<nlohmann::json>(
+            Method::Get, fmt::format("{}/authors/{}/messages", _base, common::urlEncode(author)), {}, _headers
+        ).then(
+            [](const nlohmann::json& messages) {
+                std::vector<AuthorMessage> result;
+                for (const auto& m : messages) {
+                    result.push_back({ m.at("id").template get<std::size_t>(), m.at("message").template get<Message>() });
+                }
+                return result;
+            },
+            Pistache::Async::Throw
+        );
+    }
+    Promise<std::vector<AuthorComment>> authorComments(std::string_view author) const {
+        return _http.json<nlohmann::json>(
+            Method::Get, fmt::format("{}/authors/{}/comments", _base, common::urlEncode(author)), {}, _headers
+        ).then(
+            [](const nlohmann::json& comments) {
+                std::vector<AuthorComment> result;
+                for (const auto& c : comments) {
+                    result.push_back({
+                        c.at("message").template get<std::size_t>(),
+                        c.at("comment").template get<std::size_t>(),
+                        c.at("contents").template get<std::string>()
+                    });
+                }
+                return result;
+            },
+            Pistache::Async::Throw
+        );
+    }
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <chrono>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -17,41 +18,26 @@
 #include <pistache/serializer/rapidjson.h>
 #include <pistache/client.h>
 
+#include "common/sync_wait.h"
+#include "common/encoded_response.h"
+#include "common/error_response.h"
+#include "pubsub_client.h"
+
 using namespace Pistache;
 
 #include <nlohmann/json.hpp>
 using namespace nlohmann::literals;
 
-namespace ns {
-
 #include "shared.h"
 
-void to_json(nlohmann::json &j, const Message &m) {
-    j = nlohmann::json{
-        {"author", m.author},
-        {"contents", m.contents}
-    };
-}
-void from_json(const nlohmann::json &j, Message &m) {
-    j.at("author").get_to(m.author);
-    j.at("contents").get_to(m.contents);
-}
-void to_json(nlohmann::json &j, const Subscription &s) {
-    j = nlohmann::json{
-        {"client_callback_url", s.client_callback_url},
-    };
-}
-void from_json(const nlohmann::json &j, Subscription &s) {
-    j.at("client_callback_url").get_to(s.client_callback_url);
-}
-
-}
-
 auto logger = spdlog::stdout_color_mt("client");
 
 struct ClientSubscriber {
     using Self = ClientSubscriber;
 
+    // Largest body taken, as received and once decompressed.
+    static constexpr std::size_t max_body_bytes = 16 * 1024 * 1024;
+
     uint16_t _port;
     uint _num_threads;
     Address _address{"localhost", _port};
@@ -69,9 +55,42 @@ struct ClientSubscriber {
                 throw std::runtime_error(
                     fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString()));
             }
-            const auto message = nlohmann::json::parse(request.body()).template get<ns::Message>();
+            const auto decoded = common::decodedBody(request, max_body_bytes);
+            if (!decoded) {
+                common::sendError(response, decoded.error());
+                return;
+            }
+            const auto& body = *decoded;
+            const auto message = nlohmann::json::parse(body).template get<ns::Message>();
+
+            logger->info("Received : {}", body);
+
+            response.send(Http::Code::Ok, "Received!");
+        }
+        catch (const std::exception &e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void batchInbox(const Rest::Request &request, Http::ResponseWriter response) {
+        try {
+            if (request.headers().has("/json")) {
+                throw std::runtime_error(
+                    fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString()));
+            }
+            const auto decoded = common::decodedBody(request, max_body_bytes);
+            if (!decoded) {
+                common::sendError(response, decoded.error());
+                return;
+            }
+            const auto& body = *decoded;
+            const auto messages = nlohmann::json::parse(body).template get<std::vector<ns::Message>>();
 
-            logger->info("Received : {}", request.body());
+            logger->info("Received batch of {} : {}", messages.size(), body);
 
             response.send(Http::Code::Ok, "Received!");
         }
@@ -85,7 +104,7 @@ struct ClientSubscriber {
     }
 
     void init() {
-        _end_point->init(Http::Endpoint::options().threads(_num_threads));
+        _end_point->init(Http::Endpoint::options().threads(_num_threads).maxRequestSize(max_body_bytes));
 
         describe();
 
@@ -116,6 +135,11 @@ struct ClientSubscriber {
             .consumes(MIME(Application, Json))
             .response(Http::Code::Ok, "Received message!")
             .response(Http::Code::Internal_Server_Error, "Error during receiving message!");
+
+        version_path.route(_desc.post("/batch-inbox")).bind(&Self::batchInbox, this)
+            .consumes(MIME(Application, Json))
+            .response(Http::Code::Ok, "Received messages!")
+            .response(Http::Code::Internal_Server_Error, "Error during receiving messages!");
     }
 };
 
@@ -123,42 +147,57 @@ int main(int argc, char **argv)
 {
     CLI::App app("Client pub/sub app");
 
-    auto content_type_header = std::make_shared<Http::Header::ContentType>(MIME(Application, Json));
-
     std::string author = "";
     std::string contents = "";
+    std::string topic = "";
+    std::vector<std::string> topics;
+    std::string from = "latest";
     int port = 0;
     int client_port = 0;
+    int timeout_ms = 5000;
+    std::size_t batch_size = 0;
+    uint linger_ms = 0;
+    uint lease_ms = 60'000;
+    std::size_t window = 0;
+    std::string accept_encoding;
 
     auto *app_subcriber = app.add_subcommand("subscriber");
     app_subcriber->add_option("-o,--port", port, "Server port.");
+    app_subcriber->add_option("-t,--timeout", timeout_ms, "Milliseconds to wait for server response.");
     app_subcriber->add_option("-c,--client-port", client_port, "Client port to send to delivered messages.");
+    app_subcriber->add_option("-p,--topics", topics, "Topics or patterns ('*', '#') to subscribe to, all if none.");
+    app_subcriber->add_option("-f,--from", from, "Offset to start from: latest, earliest, committed or a number.");
+    app_subcriber->add_option("-b,--batch-size", batch_size, "Receive messages in batches of up to this many.");
+    app_subcriber->add_option("-l,--linger", linger_ms, "Milliseconds server waits for a batch to fill up.");
+    app_subcriber->add_option("-e,--lease", lease_ms, "Milliseconds of failing deliveries after which server drops subscription.");
+    app_subcriber->add_option("-W,--window", window, "Deliveries in flight at once, server's default if 0.");
+    app_subcriber->add_option("-z,--accept-encoding", accept_encoding, "Codings inbox accepts (gzip, zstd), uncompressed if none.");
     app_subcriber->callback([&] {
-        auto inbox_addr = fmt::format("localhost:{}/v1/client/inbox", client_port);
-        auto server_base_addr = fmt::format("localhost:{}/v1", port);
-
-        Http::Experimental::Client client{};
-        auto opts = Http::Experimental::Client::options().threads(1).maxConnectionsPerHost(1);
-        client.init(opts);
-
-        ns::Subscription sub{ .client_callback_url = inbox_addr };
-        nlohmann::json body = sub;
-    
-        std::atomic<bool> got_response = false;
-        auto promise = client
-            .post(server_base_addr + "/subscribe")
-            .body(body.dump())
-            .header(content_type_header)
-            .send().then([&](const Http::Response& response) { 
-                got_response = true;
-                logger->info(response.body());
-            },
-            Async::Throw
+        auto inbox_addr = fmt::format(
+            "localhost:{}/v1/client/{}", client_port, batch_size > 1 ? "batch-inbox" : "inbox"
         );
-
-        while (!got_response) {}
-        
-        client.shutdown();
+        {
+            const PubSubClient client(
+                fmt::format("localhost:{}", port),
+                common::ApiClient(common::ClientOptions{ .connections_per_host = 1, .timeout = std::chrono::milliseconds(timeout_ms) })
+            );
+            ns::Subscription sub{
+                .client_callback_url = inbox_addr,
+                .topics = std::move(topics),
+                .from = std::move(from),
+                .batch_size = batch_size,
+                .linger_ms = linger_ms,
+                .lease_ms = lease_ms,
+                .window = window,
+                .accept_encoding = std::move(accept_encoding)
+            };
+            try {
+                logger->info(common::waitFor(client.subscribe(sub), std::chrono::milliseconds(timeout_ms)));
+            } catch (const std::exception& e) {
+                logger->error(e.what());
+                return;
+            }
+        }
 
         logger->info("Polling...");
         ClientSubscriber client_subscriber(client_port, 1);
@@ -166,36 +205,81 @@ int main(int argc, char **argv)
         client_subscriber.run();
     });
 
+    auto *app_unsubcriber = app.add_subcommand("unsubscriber");
+    app_unsubcriber->add_option("-o,--port", port, "Server port.");
+    app_unsubcriber->add_option("-t,--timeout", timeout_ms, "Milliseconds to wait for server response.");
+    app_unsubcriber->add_option("-c,--client-port", client_port, "Client port messages were delivered to.");
+    app_unsubcriber->add_option("-b,--batch-size", batch_size, "Batch size client subscribed with.");
+    app_unsubcriber->callback([&] {
+        auto inbox_addr = fmt::format(
+            "localhost:{}/v1/client/{}", client_port, batch_size > 1 ? "batch-inbox" : "inbox"
+        );
+        const PubSubClient client(
+            fmt::format("localhost:{}", port),
+            common::ApiClient(common::ClientOptions{ .connections_per_host = 1, .timeout = std::chrono::milliseconds(timeout_ms) })
+        );
+        try {
+            logger->info(common::waitFor(client.unsubscribe(inbox_addr), std::chrono::milliseconds(timeout_ms)));
+        } catch (const std::exception& e) {
+            logger->error(e.what());
+        }
+    });
+
     auto *app_publisher = app.add_subcommand("publisher");
     app_publisher->add_option("-o,--port", port, "Server port.");
+    app_publisher->add_option("-t,--timeout", timeout_ms, "Milliseconds to wait for server response.");
     app_publisher->add_option("-a,--author", author, "Author of to be published message.");
     app_publisher->add_option("-m,--contents", contents, "Contents of to be published message.");
+    app_publisher->add_option("-p,--topic", topic, "Topic of to be published message.");
     app_publisher->callback([&] {
-        auto inbox_addr = fmt::format("localhost:{}/v1/client/inbox", client_port);
-        auto server_base_addr = fmt::format("localhost:{}/v1", port);
-
-        Http::Experimental::Client client{};
-        auto opts = Http::Experimental::Client::options().threads(1).maxConnectionsPerHost(1);
-        client.init(opts);
-
-        ns::Message sub{ .author = std::move(author), .contents = std::move(contents) };
-        nlohmann::json body = sub;
-
-        std::atomic<bool> got_response = false;
-        auto promise = client
-            .post(server_base_addr + "/publish")
-            .body(body.dump())
-            .header(content_type_header)
-            .send().then([&](const Http::Response& response) { 
-                got_response = true;
-                logger->info(response.body());
-            },
-            Async::Throw
+        const auto timeout = std::chrono::milliseconds(timeout_ms);
+        PubSubClient client(
+            fmt::format("localhost:{}", port),
+            common::ApiClient(common::ClientOptions{ .connections_per_host = 1, .timeout = timeout })
         );
+        try {
+            // Goes straight to the broker owning topic's partition, single broker otherwise.
+            try {
+                common::waitFor(client.cluster(), timeout);
+            } catch (const common::ApiError& e) {
+                logger->warn("No cluster information: {}", e.what());
+            }
+            const ns::Message message{ .author = std::move(author), .contents = std::move(contents), .topic = std::move(topic) };
+            logger->info(common::waitFor(client.publish(message), timeout));
+        } catch (const std::exception& e) {
+            logger->error(e.what());
+        }
+    });
 
-        while (!got_response) {}
-        
-        client.shutdown();
+    uint poll_timeout_ms = 30000;
+    std::size_t max_messages = 100;
+    auto *app_poller = app.add_subcommand("poller");
+    app_poller->add_option("-o,--port", port, "Server port.");
+    app_poller->add_option("-t,--timeout", timeout_ms, "Milliseconds to wait for server response on top of poll timeout.");
+    app_poller->add_option("-p,--topics", topics, "Topics or patterns ('*', '#') to poll, all if none.");
+    app_poller->add_option("-f,--from", from, "Offset to start from: latest, earliest or a number.");
+    app_poller->add_option("-w,--wait", poll_timeout_ms, "Milliseconds server holds the poll when nothing arrives.");
+    app_poller->add_option("-n,--max", max_messages, "Most messages a single poll returns.");
+    app_poller->callback([&] {
+        const PubSubClient client(
+            fmt::format("localhost:{}", port),
+            common::ApiClient(common::ClientOptions{ .connections_per_host = 1, .timeout = std::chrono::milliseconds(timeout_ms) })
+        );
+        const auto wait = std::chrono::milliseconds(poll_timeout_ms);
+        while (true) {
+            try {
+                const auto result = common::waitFor(
+                    client.poll(from, topics, max_messages, wait), std::chrono::milliseconds(timeout_ms) + wait
+                );
+                for (const auto& record : result.records) {
+                    logger->info("Received {} : {}", record.offset, nlohmann::json(record.message).dump());
+                }
+                from = std::to_string(result.next_offset);
+            } catch (const std::exception& e) {
+                logger->error(e.what());
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+        }
     });
 
     CLI11_PARSE(app, argc, argv);
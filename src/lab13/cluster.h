@@ -0,0 +1,93 @@
+#ifndef LAB13_CLUSTER_H
+#define LAB13_CLUSTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+#include "hash_ring.h"
+
+// Broker membership. Peers come from static configuration, a peer is part of
+// the ring while it answered a ping within peer_timeout. Every change of the
+// live set rebuilds the ring, which is what rebalances partitions.
+struct Cluster {
+    using Clock = std::chrono::steady_clock;
+
+    std::string _self;
+    std::vector<std::string> _peers;
+    Clock::duration _peer_timeout;
+
+    std::unordered_map<std::string, Clock::time_point> _last_seen;
+    std::shared_ptr<const HashRing> _ring;
+
+    mutable std::mutex _m;
+
+    Cluster(std::string self, std::vector<std::string> peers, Clock::duration peer_timeout = std::chrono::seconds(3))
+        : _self(std::move(self)),
+          _peers(std::move(peers)),
+          _peer_timeout(peer_timeout),
+          _ring(std::make_shared<const HashRing>(std::vector<std::string>{ _self })) {
+        std::erase(_peers, _self);
+    }
+
+    const std::string& self() const noexcept {
+        return _self;
+    }
+    const std::vector<std::string>& peers() const noexcept {
+        return _peers;
+    }
+
+    std::shared_ptr<const HashRing> ring() const {
+        std::lock_guard<std::mutex> lock(_m);
+        return _ring;
+    }
+
+    // Owning broker of the topic's partition.
+    std::string owner(std::string_view topic) const {
+        return ring()->owner(partitionKey(topic));
+    }
+
+    // Records a successful ping, returns true when peer just (re)joined.
+    bool seen(const std::string& peer, Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(_m);
+        const auto it = _last_seen.find(peer);
+        const bool joined = it == _last_seen.end() || now - it->second > _peer_timeout;
+        _last_seen[peer] = now;
+        if (joined) {
+            rebuild(now);
+        }
+        return joined;
+    }
+
+    // Drops peers which stopped answering, returns those which left.
+    std::vector<std::string> expire(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(_m);
+        std::vector<std::string> left;
+        for (const auto& broker : _ring->brokers()) {
+            if (broker != _self && now - _last_seen[broker] > _peer_timeout) {
+                left.push_back(broker);
+            }
+        }
+        if (!left.empty()) {
+            rebuild(now);
+        }
+        return left;
+    }
+
+private:
+    void rebuild(Clock::time_point now) {
+        std::vector<std::string> live{ _self };
+        for (const auto& [peer, last_seen] : _last_seen) {
+            if (now - last_seen <= _peer_timeout) {
+                live.push_back(peer);
+            }
+        }
+        _ring = std::make_shared<const HashRing>(std::move(live));
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef LAB13_DEAD_LETTERS_H
+#define LAB13_DEAD_LETTERS_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <memory>
+
+// Bodies which couldn't be delivered after all retries. Bounded, oldest
+// letters are evicted first.
+struct DeadLetterStore {
+    struct Letter {
+        std::string url;
+        std::shared_ptr<const std::string> body;
+        std::string reason;
+        uint attempts;
+    };
+
+    std::size_t _capacity;
+    std::deque<Letter> _letters;
+    std::size_t _evicted{ 0 };
+
+    mutable std::mutex _m;
+
+    explicit DeadLetterStore(std::size_t capacity) : _capacity(capacity) {}
+
+    void push(Letter letter) {
+        std::lock_guard<std::mutex> lock(_m);
+        if (_capacity == 0) {
+            ++_evicted;
+            return;
+        }
+        if (_letters.size() >= _capacity) {
+            _letters.pop_front();
+            ++_evicted;
+        }
+        _letters.push_back(std::move(letter));
+    }
+
+    std::vector<Letter> snapshot() const {
+        std::lock_guard<std::mutex> lock(_m);
+        return { _letters.begin(), _letters.end() };
+    }
+};
+
+#endif
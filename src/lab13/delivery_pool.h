@@ -0,0 +1,182 @@
+#ifndef LAB13_DELIVERY_POOL_H
+#define LAB13_DELIVERY_POOL_H
+
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+
+#include <pistache/client.h>
+
+// Worker pool used for subscriber fan-out. Every worker owns its own http
+// client (and so its own reactor thread), tasks are run with that client.
+// Delayed tasks (retries) wait on a single timer thread and are handed to the
+// workers once due. Coroutines hop onto a worker with co_await schedule() or
+// co_await after(delay), a hop still waiting when the pool stops resumes with
+// a null client so the coroutine can finish.
+struct DeliveryPool {
+    using Client = Pistache::Http::Experimental::Client;
+    using Task = std::function<void(Client&)>;
+    using Clock = std::chrono::steady_clock;
+
+    struct DelayedTask {
+        Clock::time_point due;
+        Task task;
+        std::function<void()> dropped;
+
+        bool operator>(const DelayedTask& other) const { return due > other.due; }
+    };
+
+    uint _num_workers;
+    int _connections_per_host;
+
+    std::queue<Task> _tasks;
+    std::priority_queue<DelayedTask, std::vector<DelayedTask>, std::greater<>> _delayed_tasks;
+    bool _stopped{ false };
+
+    std::mutex _m;
+    std::condition_variable _cv;
+    std::condition_variable _timer_cv;
+
+    std::vector<std::thread> _workers;
+    std::thread _timer;
+
+    DeliveryPool(uint num_workers, int connections_per_host = 8)
+        : _num_workers(std::max(num_workers, 1U)),
+          _connections_per_host(connections_per_host) {
+        for (uint i = 0; i < _num_workers; ++i) {
+            _workers.emplace_back(&DeliveryPool::work, this);
+        }
+        _timer = std::thread(&DeliveryPool::time, this);
+    }
+
+    ~DeliveryPool() {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _stopped = true;
+        }
+        _cv.notify_all();
+        _timer_cv.notify_one();
+        _timer.join();
+        for (auto& worker : _workers) {
+            worker.join();
+        }
+    }
+
+    // Resumes awaiting coroutine on a worker, giving it the worker's client. Null
+    // client means pool is stopping and the task couldn't be queued anymore.
+    struct Hop {
+        DeliveryPool& pool;
+        Clock::duration delay;
+        Client* client = nullptr;
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            auto task = [this, handle](Client& worker_client) {
+                client = &worker_client;
+                handle.resume();
+            };
+            if (delay > Clock::duration::zero()) {
+                return pool.submitAfter(delay, std::move(task), [handle] { handle.resume(); });
+            }
+            return pool.submit(std::move(task));
+        }
+        Client* await_resume() const noexcept {
+            return client;
+        }
+    };
+
+    Hop schedule() {
+        return { *this, Clock::duration::zero() };
+    }
+    Hop after(Clock::duration delay) {
+        return { *this, delay };
+    }
+
+    // False once the pool is stopping, task is dropped then.
+    bool submit(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (_stopped) {
+                return false;
+            }
+            _tasks.push(std::move(task));
+        }
+        _cv.notify_one();
+        return true;
+    }
+
+    // Delayed tasks still waiting when the pool stops are dropped, dropped is
+    // called instead of them then, on the timer thread.
+    bool submitAfter(Clock::duration delay, Task task, std::function<void()> dropped = {}) {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            if (_stopped) {
+                return false;
+            }
+            _delayed_tasks.push({ Clock::now() + delay, std::move(task), std::move(dropped) });
+        }
+        _timer_cv.notify_one();
+        return true;
+    }
+
+    void work() {
+        Client client{};
+        // Kept alive so a subscriber's window is pipelined over its established connections.
+        client.init(Client::options().threads(1).maxConnectionsPerHost(_connections_per_host).keepAlive(true));
+
+        while (true) {
+            std::unique_lock<std::mutex> lock(_m);
+            _cv.wait(lock, [this] { return _stopped || !_tasks.empty(); });
+            if (_tasks.empty()) {
+                break;
+            }
+            auto task = std::move(_tasks.front());
+            _tasks.pop();
+            lock.unlock();
+
+            task(client);
+        }
+
+        client.shutdown();
+    }
+
+    void time() {
+        std::unique_lock<std::mutex> lock(_m);
+        while (!_stopped) {
+            if (_delayed_tasks.empty()) {
+                _timer_cv.wait(lock);
+                continue;
+            }
+            if (_timer_cv.wait_until(lock, _delayed_tasks.top().due) == std::cv_status::no_timeout) {
+                continue;
+            }
+            while (!_delayed_tasks.empty() && _delayed_tasks.top().due <= Clock::now()) {
+                _tasks.push(std::move(const_cast<DelayedTask&>(_delayed_tasks.top()).task));
+                _delayed_tasks.pop();
+                _cv.notify_one();
+            }
+        }
+
+        std::vector<std::function<void()>> dropped;
+        while (!_delayed_tasks.empty()) {
+            if (auto& task = const_cast<DelayedTask&>(_delayed_tasks.top()); task.dropped) {
+                dropped.push_back(std::move(task.dropped));
+            }
+            _delayed_tasks.pop();
+        }
+        lock.unlock();
+        for (const auto& f : dropped) {
+            f();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef LAB13_HASH_RING_H
+#define LAB13_HASH_RING_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+
+// Topics are partitioned by their first level, "orders.eu.created" and
+// "orders.us" always end up on the same broker.
+inline std::string_view partitionKey(std::string_view topic) {
+    return topic.substr(0, topic.find('.'));
+}
+
+// Consistent hashing of partition keys onto brokers ("host:port"). Every broker
+// gets virtual_nodes points on the ring so partitions spread evenly, and a broker
+// joining or leaving only moves the partitions next to its own points.
+// Hash is stable across processes, brokers and clients agree on owners.
+struct HashRing {
+    static constexpr std::size_t virtual_nodes = 64;
+
+    std::vector<std::string> _brokers;
+    // Sorted by hash, second is index into _brokers.
+    std::vector<std::pair<uint64_t, std::size_t>> _points;
+
+    HashRing() = default;
+    explicit HashRing(std::vector<std::string> brokers) : _brokers(std::move(brokers)) {
+        std::sort(_brokers.begin(), _brokers.end());
+        _brokers.erase(std::unique(_brokers.begin(), _brokers.end()), _brokers.end());
+
+        _points.reserve(_brokers.size() * virtual_nodes);
+        for (std::size_t i = 0; i < _brokers.size(); ++i) {
+            for (std::size_t node = 0; node < virtual_nodes; ++node) {
+                _points.emplace_back(hash(_brokers[i] + '#' + std::to_string(node)), i);
+            }
+        }
+        std::sort(_points.begin(), _points.end());
+    }
+
+    bool empty() const noexcept {
+        return _brokers.empty();
+    }
+    const std::vector<std::string>& brokers() const noexcept {
+        return _brokers;
+    }
+
+    // First point clockwise from the key's hash. Ring must not be empty.
+    const std::string& owner(std::string_view key) const {
+        const auto h = hash(key);
+        auto it = std::lower_bound(_points.begin(), _points.end(), std::make_pair(h, std::size_t{ 0 }));
+        if (it == _points.end()) {
+            it = _points.begin();
+        }
+        return _brokers[it->second];
+    }
+
+    // FNV-1a followed by murmur's finalizer so similar keys land far apart.
+    static uint64_t hash(std::string_view key) noexcept {
+        uint64_t h = 14695981039346656037ULL;
+        for (const auto c : key) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef LAB13_MESSAGE_LOG_H
+#define LAB13_MESSAGE_LOG_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <filesystem>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <fmt/format.h>
+
+struct LogOptions {
+    std::filesystem::path directory{ "pubsub-log" };
+    std::size_t segment_bytes = 64 << 20;
+    std::size_t index_interval_bytes = 4 << 10;
+    std::size_t retention_bytes = std::size_t{ 1 } << 30;
+    std::chrono::seconds retention_time{ 7 * 24 * 3600 };
+};
+
+struct LogRecord {
+    uint64_t offset;
+    int64_t timestamp_ms;
+    std::string_view topic;
+    std::string_view payload;
+};
+
+// Preallocated file mapped into memory, grows only by remapping a new file.
+struct MappedFile {
+    int _fd{ -1 };
+    char* _data{ nullptr };
+    std::size_t _capacity{ 0 };
+
+    MappedFile(const std::filesystem::path& path, std::size_t capacity) {
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (_fd < 0) {
+            throw std::runtime_error(fmt::format("Couldn't open {}: {}", path.string(), std::strerror(errno)));
+        }
+        const auto size = std::filesystem::file_size(path);
+        _capacity = std::max<std::size_t>(size, capacity);
+        if (size < _capacity && ::ftruncate(_fd, static_cast<off_t>(_capacity)) != 0) {
+            ::close(_fd);
+            throw std::runtime_error(fmt::format("Couldn't resize {}: {}", path.string(), std::strerror(errno)));
+        }
+        auto* data = ::mmap(nullptr, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(_fd);
+            throw std::runtime_error(fmt::format("Couldn't map {}: {}", path.string(), std::strerror(errno)));
+        }
+        _data = static_cast<char*>(data);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+        ::munmap(_data, _capacity);
+        ::close(_fd);
+    }
+
+    void sync() {
+        ::msync(_data, _capacity, MS_ASYNC);
+    }
+};
+
+// One file of consecutive records plus its sparse index. Record layout is
+// header followed by topic and payload, `size` is stored last so a torn append
+// reads as end of segment. Index entries map relative offset to file position every
+// index_interval_bytes, record at position 0 is implicit.
+struct LogSegment {
+    struct Header {
+        uint32_t size;
+        uint32_t topic_size;
+        uint64_t offset;
+        int64_t timestamp_ms;
+
+        std::size_t length() const noexcept {
+            return sizeof(Header) + topic_size + size;
+        }
+    };
+    struct IndexEntry {
+        uint32_t relative_offset;
+        uint32_t position;
+    };
+
+    uint64_t _base_offset;
+    std::filesystem::path _path;
+    std::filesystem::path _index_path;
+    MappedFile _records;
+    MappedFile _index;
+    std::size_t _index_interval;
+
+    // Written by the single appender, published with release for readers.
+    std::atomic<std::size_t> _size{ 0 };
+    std::atomic<std::size_t> _index_count{ 0 };
+    std::atomic<uint64_t> _next_offset;
+    std::atomic<int64_t> _last_timestamp_ms{ 0 };
+    std::size_t _last_indexed_position{ 0 };
+    bool _removed{ false };
+
+    LogSegment(const std::filesystem::path& directory, uint64_t base_offset, std::size_t capacity, std::size_t index_interval)
+        : _base_offset(base_offset),
+          _path(directory / fmt::format("{:020}.log", base_offset)),
+          _index_path(directory / fmt::format("{:020}.index", base_offset)),
+          _records(_path, capacity),
+          _index(_index_path, (capacity / std::max<std::size_t>(index_interval, 1) + 1) * sizeof(IndexEntry)),
+          _index_interval(std::max<std::size_t>(index_interval, 1)),
+          _next_offset(base_offset) {
+        recover();
+    }
+    ~LogSegment() {
+        if (_removed) {
+            std::error_code ec;
+            std::filesystem::remove(_path, ec);
+            std::filesystem::remove(_index_path, ec);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return _size.load(std::memory_order_acquire);
+    }
+    bool fits(std::size_t record_size) const noexcept {
+        return size() + sizeof(Header) + record_size <= _records._capacity;
+    }
+
+    uint64_t append(std::string_view topic, std::string_view payload, int64_t timestamp_ms) {
+        const auto position = size();
+        const auto offset = _next_offset.load(std::memory_order_relaxed);
+
+        Header header{ 0, static_cast<uint32_t>(topic.size()), offset, timestamp_ms };
+        auto* data = _records._data + position + sizeof(Header);
+        std::memcpy(data, topic.data(), topic.size());
+        std::memcpy(data + topic.size(), payload.data(), payload.size());
+        std::memcpy(_records._data + position, &header, sizeof(Header));
+        header.size = static_cast<uint32_t>(payload.size());
+        std::memcpy(_records._data + position + offsetof(Header, size), &header.size, sizeof(header.size));
+
+        if (position != 0 && position - _last_indexed_position >= _index_interval) {
+            const auto count = _index_count.load(std::memory_order_relaxed);
+            if ((count + 1) * sizeof(IndexEntry) <= _index._capacity) {
+                const IndexEntry entry{ static_cast<uint32_t>(offset - _base_offset), static_cast<uint32_t>(position) };
+                std::memcpy(_index._data + count * sizeof(IndexEntry), &entry, sizeof(entry));
+                _index_count.store(count + 1, std::memory_order_release);
+                _last_indexed_position = position;
+            }
+        }
+
+        _last_timestamp_ms.store(timestamp_ms, std::memory_order_relaxed);
+        _next_offset.store(offset + 1, std::memory_order_release);
+        _size.store(position + header.length(), std::memory_order_release);
+        return offset;
+    }
+
+    // Calls fn for records starting at offset `from`, stops early when fn returns false.
+    template<typename Fn>
+    void read(uint64_t from, Fn&& fn) const {
+        const auto end = size();
+        auto position = seek(from);
+        while (position + sizeof(Header) <= end) {
+            Header header;
+            std::memcpy(&header, _records._data + position, sizeof(Header));
+            if (header.offset >= from) {
+                const auto* data = _records._data + position + sizeof(Header);
+                const LogRecord record{
+                    header.offset,
+                    header.timestamp_ms,
+                    std::string_view(data, header.topic_size),
+                    std::string_view(data + header.topic_size, header.size)
+                };
+                if (!fn(record)) {
+                    return;
+                }
+            }
+            position += header.length();
+        }
+    }
+
+    void sync() {
+        _records.sync();
+        _index.sync();
+    }
+
+private:
+    // Position of the last indexed record at or before offset.
+    std::size_t seek(uint64_t offset) const {
+        if (offset <= _base_offset) {
+            return 0;
+        }
+        const auto relative = offset - _base_offset;
+        const auto count = _index_count.load(std::memory_order_acquire);
+        const auto* entries = reinterpret_cast<const IndexEntry*>(_index._data);
+        const auto it = std::upper_bound(entries, entries + count, relative,
+            [](uint64_t value, const IndexEntry& entry) { return value < entry.relative_offset; });
+        return it == entries ? 0 : std::prev(it)->position;
+    }
+
+    void recover() {
+        const auto* entries = reinterpret_cast<const IndexEntry*>(_index._data);
+        std::size_t count = 0;
+        const auto max_entries = _index._capacity / sizeof(IndexEntry);
+        while (count < max_entries && entries[count].position != 0) {
+            ++count;
+        }
+
+        std::size_t position = count == 0 ? 0 : entries[count - 1].position;
+        _last_indexed_position = position;
+        while (position + sizeof(Header) <= _records._capacity) {
+            Header header;
+            std::memcpy(&header, _records._data + position, sizeof(Header));
+            if (header.size == 0 || position + header.length() > _records._capacity) {
+                break;
+            }
+            _next_offset.store(header.offset + 1, std::memory_order_relaxed);
+            _last_timestamp_ms.store(header.timestamp_ms, std::memory_order_relaxed);
+            position += header.length();
+        }
+        _index_count.store(count, std::memory_order_release);
+        _size.store(position, std::memory_order_release);
+    }
+};
+
+// Append-only log of published messages split into segments. Appends come from
+// a single thread (the deliverer), reads from anywhere. Offsets are dense and
+// never reused, whole segments are dropped by retention.
+struct MessageLog {
+    using Clock = std::chrono::system_clock;
+
+    LogOptions _options;
+    std::vector<std::shared_ptr<LogSegment>> _segments;
+    mutable std::shared_mutex _m;
+
+    explicit MessageLog(LogOptions options) : _options(std::move(options)) {
+        std::filesystem::create_directories(_options.directory);
+
+        std::vector<uint64_t> base_offsets;
+        for (const auto& entry : std::filesystem::directory_iterator(_options.directory)) {
+            if (entry.path().extension() == ".log") {
+                base_offsets.push_back(std::stoull(entry.path().stem().string()));
+            }
+        }
+        std::sort(base_offsets.begin(), base_offsets.end());
+        for (const auto base_offset : base_offsets) {
+            _segments.push_back(std::make_shared<LogSegment>(
+                _options.directory, base_offset, _options.segment_bytes, _options.index_interval_bytes
+            ));
+        }
+        if (_segments.empty()) {
+            roll(0);
+        }
+    }
+
+    uint64_t startOffset() const {
+        std::shared_lock lock(_m);
+        return _segments.front()->_base_offset;
+    }
+    uint64_t endOffset() const {
+        std::shared_lock lock(_m);
+        return _segments.back()->_next_offset.load(std::memory_order_acquire);
+    }
+
+    uint64_t append(std::string_view topic, std::string_view payload) {
+        const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+        auto active = activeSegment();
+        if (!active->fits(topic.size() + payload.size())) {
+            std::unique_lock lock(_m);
+            roll(active->_next_offset.load(std::memory_order_relaxed), topic.size() + payload.size());
+            active = _segments.back();
+            enforceRetention();
+        }
+        return active->append(topic, payload, now);
+    }
+
+    // Calls fn for every record from offset `from` on (clamped to what retention
+    // left), fn returning false stops the scan. Returns offset to continue from.
+    template<typename Fn>
+    uint64_t read(uint64_t from, Fn&& fn) const {
+        std::vector<std::shared_ptr<LogSegment>> segments;
+        {
+            std::shared_lock lock(_m);
+            const auto it = std::upper_bound(_segments.begin(), _segments.end(), from,
+                [](uint64_t offset, const auto& segment) { return offset < segment->_base_offset; });
+            segments.assign(it == _segments.begin() ? it : std::prev(it), _segments.end());
+        }
+        auto next = segments.empty() ? from : std::max(from, segments.front()->_base_offset);
+        bool stopped = false;
+        for (const auto& segment : segments) {
+            segment->read(next, [&](const LogRecord& record) {
+                next = record.offset + 1;
+                stopped = !fn(record);
+                return !stopped;
+            });
+            if (stopped) {
+                break;
+            }
+        }
+        return next;
+    }
+
+    void sync() {
+        std::shared_lock lock(_m);
+        for (const auto& segment : _segments) {
+            segment->sync();
+        }
+    }
+
+    // Time based retention also needs to run when nothing is being appended.
+    void expire() {
+        std::unique_lock lock(_m);
+        enforceRetention();
+    }
+
+private:
+    std::shared_ptr<LogSegment> activeSegment() const {
+        std::shared_lock lock(_m);
+        return _segments.back();
+    }
+
+    // An empty active segment would share its base offset, and so its files,
+    // with the next one. It's replaced by a big enough one over the same files
+    // instead, they're only ever grown.
+    void roll(uint64_t base_offset, std::size_t min_record = 0) {
+        auto segment = std::make_shared<LogSegment>(
+            _options.directory,
+            base_offset,
+            std::max(_options.segment_bytes, sizeof(LogSegment::Header) + min_record),
+            _options.index_interval_bytes
+        );
+        if (!_segments.empty() && _segments.back()->size() == 0) {
+            _segments.back() = std::move(segment);
+        } else {
+            _segments.push_back(std::move(segment));
+        }
+    }
+
+    // Active segment is never dropped. Files are unlinked once the last reader
+    // lets go of the segment.
+    void enforceRetention() {
+        std::size_t total = 0;
+        for (const auto& segment : _segments) {
+            total += segment->size();
+        }
+        const auto deadline = std::chrono::duration_cast<std::chrono::milliseconds>(
+            (Clock::now() - _options.retention_time).time_since_epoch()
+        ).count();
+        while (_segments.size() > 1) {
+            const auto& oldest = _segments.front();
+            if (total <= _options.retention_bytes && oldest->_last_timestamp_ms.load(std::memory_order_relaxed) >= deadline) {
+                break;
+            }
+            total -= oldest->size();
+            oldest->_removed = true;
+            _segments.erase(_segments.begin());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef LAB13_MPSC_QUEUE_H
+#define LAB13_MPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <new>
+#include <bit>
+#include <cstdint>
+#include <algorithm>
+
+// Bounded lock-free queue for many producers and one consumer (publish handlers
+// feeding the deliverer). Slots carry a sequence number as in Vyukov's bounded
+// queue, producers claim slots with a CAS on _tail. Blocking happens only when
+// queue is empty (consumer) or full (producers) and uses futex based
+// std::atomic::wait, notifies are skipped unless someone actually sleeps.
+template<typename T>
+struct MpscQueue {
+    static constexpr std::size_t cache_line = 64;
+
+    struct alignas(cache_line) Slot {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+    struct alignas(cache_line) Signal {
+        std::atomic<uint32_t> generation{ 0 };
+        std::atomic<uint32_t> sleepers{ 0 };
+    };
+
+    std::size_t _mask;
+    std::unique_ptr<Slot[]> _slots;
+
+    alignas(cache_line) std::atomic<std::size_t> _tail{ 0 };
+    alignas(cache_line) std::size_t _head{ 0 };
+    alignas(cache_line) std::atomic<bool> _closed{ false };
+
+    Signal _not_empty;
+    Signal _not_full;
+
+    explicit MpscQueue(std::size_t capacity)
+        : _mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1),
+          _slots(std::make_unique<Slot[]>(_mask + 1)) {
+        for (std::size_t i = 0; i <= _mask; ++i) {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t capacity() const noexcept {
+        return _mask + 1;
+    }
+
+    bool closed() const noexcept {
+        return _closed.load(std::memory_order_acquire);
+    }
+
+    bool tryPush(T&& value) {
+        auto position = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = _slots[position & _mask];
+            const auto sequence = slot.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    wake(_not_empty);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocks while queue is full, returns false if queue got closed meanwhile.
+    bool push(T value) {
+        while (!_closed.load(std::memory_order_acquire)) {
+            if (tryPush(std::move(value))) {
+                return true;
+            }
+            sleep(_not_full, [this] { return !full(); });
+        }
+        return false;
+    }
+
+    // Consumer side only.
+    std::optional<T> tryPop() {
+        auto& slot = _slots[_head & _mask];
+        if (slot.sequence.load(std::memory_order_acquire) != _head + 1) {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(slot.value));
+        slot.sequence.store(_head + _mask + 1, std::memory_order_release);
+        ++_head;
+        wake(_not_full);
+        return value;
+    }
+
+    // Blocks while queue is empty, nullopt once queue is closed and drained.
+    std::optional<T> pop() {
+        while (true) {
+            if (auto value = tryPop(); value.has_value()) {
+                return value;
+            }
+            if (_closed.load(std::memory_order_acquire)) {
+                return tryPop();
+            }
+            sleep(_not_empty, [this] {
+                return _slots[_head & _mask].sequence.load(std::memory_order_acquire) == _head + 1;
+            });
+        }
+    }
+
+    void close() {
+        _closed.store(true, std::memory_order_release);
+        for (auto* signal : { &_not_empty, &_not_full }) {
+            signal->generation.fetch_add(1, std::memory_order_seq_cst);
+            signal->generation.notify_all();
+        }
+    }
+
+private:
+    bool full() const {
+        const auto position = _tail.load(std::memory_order_relaxed);
+        return _slots[position & _mask].sequence.load(std::memory_order_acquire) != position;
+    }
+
+    // Sleeper announces itself before re-checking, waker bumps generation before
+    // looking for sleepers, so either sleeper sees the change or waker sees sleeper.
+    template<typename Ready>
+    void sleep(Signal& signal, Ready ready) {
+        const auto generation = signal.generation.load(std::memory_order_seq_cst);
+        signal.sleepers.fetch_add(1, std::memory_order_seq_cst);
+        if (!ready() && !_closed.load(std::memory_order_acquire)) {
+            signal.generation.wait(generation, std::memory_order_seq_cst);
+        }
+        signal.sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+    void wake(Signal& signal) {
+        signal.generation.fetch_add(1, std::memory_order_seq_cst);
+        if (signal.sleepers.load(std::memory_order_seq_cst) != 0) {
+            signal.generation.notify_all();
+        }
+    }
+};
+
+#endif
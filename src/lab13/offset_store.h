@@ -0,0 +1,62 @@
+#ifndef LAB13_OFFSET_STORE_H
+#define LAB13_OFFSET_STORE_H
+
+#include <string>
+#include <unordered_map>
+#include <optional>
+#include <mutex>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+// Committed offsets per subscriber callback url, kept in memory and
+// periodically written as JSON next to the log so consumers can resume.
+struct OffsetStore {
+    std::filesystem::path _path;
+    std::unordered_map<std::string, uint64_t> _offsets;
+    bool _dirty{ false };
+
+    mutable std::mutex _m;
+
+    explicit OffsetStore(std::filesystem::path path) : _path(std::move(path)) {
+        if (std::ifstream file(_path); file) {
+            nlohmann::json::parse(file).get_to(_offsets);
+        }
+    }
+
+    std::optional<uint64_t> get(const std::string& url) const {
+        std::lock_guard<std::mutex> lock(_m);
+        if (const auto it = _offsets.find(url); it != _offsets.end()) {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+
+    void commit(const std::string& url, uint64_t offset) {
+        std::lock_guard<std::mutex> lock(_m);
+        auto& committed = _offsets[url];
+        if (committed != offset) {
+            committed = offset;
+            _dirty = true;
+        }
+    }
+
+    // Written to a temporary file first so a crash never leaves half of it.
+    void flush() {
+        std::lock_guard<std::mutex> lock(_m);
+        if (!_dirty) {
+            return;
+        }
+        const auto tmp = std::filesystem::path(_path).concat(".tmp");
+        {
+            std::ofstream file(tmp, std::ios::trunc);
+            file << nlohmann::json(_offsets).dump();
+        }
+        std::filesystem::rename(tmp, _path);
+        _dirty = false;
+    }
+};
+
+#endif
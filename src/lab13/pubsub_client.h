@@ -0,0 +1,140 @@
+#ifndef LAB13_PUBSUB_CLIENT_H
+#define LAB13_PUBSUB_CLIENT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include "common/api_client.h"
+#include "shared.h"
+#include "hash_ring.h"
+
+// Typed client of the Pub/Sub API. Publishes go straight to the broker owning
+// the topic's partition once the ring was fetched with cluster(), a redirect
+// from a broker that doesn't own it anymore is followed once.
+// Must outlive the calls it made.
+struct PubSubClient {
+    template<typename T>
+    using Promise = common::ApiClient::Promise<T>;
+    using Method = Pistache::Http::Method;
+
+    struct Record {
+        uint64_t offset;
+        ns::Message message;
+    };
+    struct PollResult {
+        uint64_t next_offset;
+        std::vector<Record> records;
+    };
+
+    // Eg. "localhost:8080".
+    std::string _host;
+    common::ApiClient _http;
+
+    std::shared_ptr<const HashRing> _ring;
+    mutable std::mutex _m;
+
+    explicit PubSubClient(std::string host, common::ApiClient http = common::ApiClient::shared())
+        : _host(std::move(host)),
+          _http(std::move(http)) {}
+
+    // Fetches brokers and remembers their ring for routing publishes.
+    Promise<std::vector<std::string>> cluster() {
+        return _http.json<nlohmann::json>(Method::Get, fmt::format("{}/v1/cluster", _host)).then(
+            [this](const nlohmann::json& cluster) {
+                auto brokers = cluster.at("brokers").template get<std::vector<std::string>>();
+                std::lock_guard<std::mutex> lock(_m);
+                _ring = std::make_shared<const HashRing>(brokers);
+                return brokers;
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    Promise<std::string> publish(const ns::Message& message) const {
+        auto body = nlohmann::json(message).dump();
+        return _http.send(Method::Post, publishUrl(message.topic), body).then(
+            [this, body](const Pistache::Http::Response& response) {
+                if (response.code() == Pistache::Http::Code::Temporary_Redirect) {
+                    if (const auto location = response.headers().tryGet<Pistache::Http::Header::Location>(); location != nullptr) {
+                        return _http.text(Method::Post, location->location(), body);
+                    }
+                }
+                return checked(response);
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+    // All published concurrently over the pool, settles when every one did.
+    Promise<std::vector<std::string>> publish(const std::vector<ns::Message>& messages) const {
+        std::vector<Promise<std::string>> calls;
+        calls.reserve(messages.size());
+        for (const auto& message : messages) {
+            calls.push_back(publish(message));
+        }
+        return common::ApiClient::all(std::move(calls));
+    }
+
+    Promise<std::string> subscribe(const ns::Subscription& subscription) const {
+        return _http.text(Method::Post, fmt::format("{}/v1/subscribe", _host), nlohmann::json(subscription).dump());
+    }
+
+    Promise<std::string> unsubscribe(const std::string& callback_url) const {
+        const nlohmann::json body{ {"client_callback_url", callback_url} };
+        return _http.text(Method::Delete, fmt::format("{}/v1/subscribe", _host), body.dump());
+    }
+
+    // Long poll, server holds it up to `wait` when nothing matching is there yet.
+    Promise<PollResult> poll(const std::string& offset, const std::vector<std::string>& topics,
+        std::size_t max_messages, std::chrono::milliseconds wait) const {
+        std::string topics_param;
+        for (const auto& pattern : topics) {
+            for (const auto c : pattern) {
+                topics_param += c == '#' ? std::string("%23") : std::string(1, c);
+            }
+            topics_param += ',';
+        }
+        return _http.withTimeout(_http.options().timeout + wait).json<nlohmann::json>(
+            Method::Get,
+            fmt::format("{}/v1/poll?offset={}&max={}&timeout_ms={}&topics={}",
+                _host, common::urlEncode(offset), max_messages, wait.count(), topics_param)
+        ).then(
+            [](const nlohmann::json& result) {
+                PollResult poll{ result.at("next_offset").template get<uint64_t>(), {} };
+                for (const auto& record : result.at("messages")) {
+                    poll.records.push_back({
+                        record.at("offset").template get<uint64_t>(),
+                        record.at("message").template get<ns::Message>()
+                    });
+                }
+                return poll;
+            },
+            Pistache::Async::Throw
+        );
+    }
+
+private:
+    std::string publishUrl(const std::string& topic) const {
+        std::lock_guard<std::mutex> lock(_m);
+        if (_ring && !_ring->empty()) {
+            return fmt::format("{}/v1/publish", _ring->owner(partitionKey(topic)));
+        }
+        return fmt::format("{}/v1/publish", _host);
+    }
+
+    static Promise<std::string> checked(const Pistache::Http::Response& response) {
+        const auto code = static_cast<int>(response.code());
+        if (code < 200 || code >= 300) {
+            return Promise<std::string>::rejected(common::ApiError(response.code(), response.body()));
+        }
+        return Promise<std::string>::resolved(response.body());
+    }
+};
+
+#endif
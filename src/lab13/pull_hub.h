@@ -0,0 +1,171 @@
+#ifndef LAB13_PULL_HUB_H
+#define LAB13_PULL_HUB_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+
+#include <fmt/format.h>
+
+#include <pistache/http.h>
+
+#include "message_log.h"
+#include "topic_index.h"
+
+// Consumers which pull from the log instead of exposing an inbox: long-polls
+// parked until something matching arrives and Server-Sent Events streams.
+// pump() catches every one of them up with the log, all records available at
+// that moment (up to _max_batch) go out in a single write.
+struct PullHub {
+    using Clock = std::chrono::steady_clock;
+
+    struct Poll {
+        Pistache::Http::ResponseWriter response;
+        TopicFilter filter;
+        uint64_t next;
+        std::size_t max_messages;
+        Clock::time_point deadline;
+    };
+    struct Stream {
+        Pistache::Http::ResponseStream stream;
+        TopicFilter filter;
+        uint64_t next;
+        Clock::time_point last_write;
+    };
+
+    static constexpr auto keep_alive_interval = std::chrono::seconds(15);
+
+    const MessageLog& _log;
+    std::size_t _max_batch;
+
+    std::vector<std::unique_ptr<Poll>> _polls;
+    std::vector<std::unique_ptr<Stream>> _streams;
+    std::atomic<bool> _pump_requested{ false };
+
+    // Pumping is serialized, adding consumers only takes _m briefly.
+    std::mutex _pump_m;
+    std::mutex _m;
+
+    PullHub(const MessageLog& log, std::size_t max_batch)
+        : _log(log),
+          _max_batch(max_batch) {}
+
+    // Answers right away if anything is available, parks the request otherwise
+    // and returns true. A record appended between the check and parking isn't
+    // seen by its appender's pump request, so caller has to request one itself.
+    bool poll(Pistache::Http::ResponseWriter response, TopicFilter filter, uint64_t from,
+        std::size_t max_messages, std::chrono::milliseconds timeout) {
+        auto poll = std::make_unique<Poll>(Poll{
+            std::move(response),
+            std::move(filter),
+            from,
+            std::clamp<std::size_t>(max_messages, 1, _max_batch),
+            Clock::now() + timeout
+        });
+        if (answer(*poll, false)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(_m);
+        _polls.push_back(std::move(poll));
+        return true;
+    }
+
+    void stream(Pistache::Http::ResponseStream stream, TopicFilter filter, uint64_t from) {
+        auto consumer = std::make_unique<Stream>(Stream{ std::move(stream), std::move(filter), from, Clock::now() });
+        std::lock_guard<std::mutex> lock(_m);
+        _streams.push_back(std::move(consumer));
+    }
+
+    // True when caller should run pump() on some worker, false if one is already pending.
+    bool requestPump() {
+        return !_pump_requested.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // Returns true when some stream still has records left for another pump.
+    bool pump() {
+        std::lock_guard<std::mutex> pump_lock(_pump_m);
+        _pump_requested.store(false, std::memory_order_release);
+
+        std::vector<std::unique_ptr<Poll>> polls;
+        std::vector<std::unique_ptr<Stream>> streams;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            polls.swap(_polls);
+            streams.swap(_streams);
+        }
+
+        const auto now = Clock::now();
+        bool more = false;
+        std::erase_if(polls, [&](auto& poll) { return answer(*poll, now >= poll->deadline); });
+        std::erase_if(streams, [&](auto& stream) { return !write(*stream, now, more); });
+
+        std::lock_guard<std::mutex> lock(_m);
+        std::move(polls.begin(), polls.end(), std::back_inserter(_polls));
+        std::move(streams.begin(), streams.end(), std::back_inserter(_streams));
+        return more;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> lock(_m);
+        return _polls.empty() && _streams.empty();
+    }
+
+private:
+    // Payloads are already JSON, response is assembled without reparsing them.
+    bool answer(Poll& poll, bool expired) {
+        std::string messages;
+        std::size_t count = 0;
+        poll.next = _log.read(poll.next, [&](const LogRecord& record) {
+            if (poll.filter.matches(record.topic)) {
+                fmt::format_to(std::back_inserter(messages), "{}{{\"offset\":{},\"message\":{}}}",
+                    count == 0 ? "" : ",", record.offset, record.payload);
+                ++count;
+            }
+            return count < poll.max_messages;
+        });
+        if (count == 0 && !expired) {
+            return false;
+        }
+        poll.response.send(
+            Pistache::Http::Code::Ok,
+            fmt::format("{{\"next_offset\":{},\"messages\":[{}]}}", poll.next, messages),
+            MIME(Application, Json)
+        );
+        return true;
+    }
+
+    // Returns false once the peer is gone.
+    bool write(Stream& stream, Clock::time_point now, bool& more) {
+        std::string events;
+        std::size_t count = 0;
+        stream.next = _log.read(stream.next, [&](const LogRecord& record) {
+            if (stream.filter.matches(record.topic)) {
+                fmt::format_to(std::back_inserter(events), "id: {}\nevent: message\ndata: {}\n\n", record.offset, record.payload);
+                ++count;
+            }
+            return count < _max_batch;
+        });
+        if (count == 0 && now - stream.last_write < keep_alive_interval) {
+            return true;
+        }
+        if (count == 0) {
+            events = ": keep-alive\n\n";
+        }
+        try {
+            stream.stream << events;
+            stream.stream.flush();
+        } catch (const std::exception&) {
+            return false;
+        }
+        stream.last_write = now;
+        more = more || count == _max_batch;
+        return true;
+    }
+};
+
+#endif
@@ -1,9 +1,10 @@
 #include <vector>
 #include <string_view>
-#include <queue>
+#include <optional>
+#include <charconv>
 #include <mutex>
-#include <condition_variable>
 #include <thread>
+#include <map>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -17,87 +18,379 @@
 #include <pistache/serializer/rapidjson.h>
 #include <pistache/client.h>
 
+#include "common/sync_wait.h"
+#include "common/coro.h"
+#include "common/encoded_response.h"
+#include "common/error_response.h"
+#include "common/serving.h"
+#include "delivery_pool.h"
+#include "subscriber_queue.h"
+#include "dead_letters.h"
+#include "mpsc_queue.h"
+#include "subscription_registry.h"
+#include "message_log.h"
+#include "offset_store.h"
+#include "pull_hub.h"
+#include "cluster.h"
+
 using namespace Pistache;
 
 #include <nlohmann/json.hpp>
 using namespace nlohmann::literals;
 
-namespace ns {
-
 #include "shared.h"
 
-void to_json(nlohmann::json& j, const Message& m) {
-    j = nlohmann::json{
-        {"author", m.author},
-        {"contents", m.contents}
-    };
-}
-void from_json(const nlohmann::json& j, Message& m) {
-    j.at("author").get_to(m.author);
-    j.at("contents").get_to(m.contents);
-}
-void to_json(nlohmann::json& j, const Subscription& s) {
-    j = nlohmann::json{
-        {"client_callback_url", s.client_callback_url},
-    };
-}
-void from_json(const nlohmann::json& j, Subscription& s) {
-    j.at("client_callback_url").get_to(s.client_callback_url);
-}
-
-}
-
 auto logger = spdlog::stdout_color_mt("server");
 
 struct Server {
     using Self = Server;
 
     uint16_t _port;
-    uint _num_threads;
+    common::ServingOptions _serving;
     Address _address{ "localhost", _port };
-    std::shared_ptr<Http::Endpoint> _end_point{ std::make_shared<Http::Endpoint>(_address) };
+    common::Endpoints _end_points{ _address, _serving };
     Rest::Description _desc{ "Basic Server Pub/Sub API", "0.1" };
     Rest::Router _router;
 
-    std::vector<ns::Subscription> _subscribers;
-    std::queue<ns::Message> _published_messages;
-    
-    std::thread _deliverer_thread;
+    Cluster _cluster;
+    DeliveryOptions _delivery_options;
+    DeadLetterStore _dead_letters;
+    MessageLog _log;
+    OffsetStore _offsets;
+    PullHub _pulls;
+
+    // Guarded by _m, deliverer grabs its snapshot and fans out without holding _m.
+    SubscriptionRegistry _registry;
+    MpscQueue<ns::Message> _published_messages;
 
     mutable std::mutex _m;
-    std::condition_variable _cv;
 
-    Server(uint16_t port, uint num_threads = std::thread::hardware_concurrency())
+    DeliveryPool _delivery_pool;
+    std::thread _deliverer_thread;
+
+    Server(uint16_t port, common::ServingOptions serving = {},
+        uint num_delivery_workers = std::thread::hardware_concurrency(),
+        DeliveryOptions delivery_options = {}, std::size_t dead_letter_capacity = 1024,
+        LogOptions log_options = {}, std::vector<std::string> peers = {})
         : _port(port),
-          _num_threads(num_threads),
+          _serving(serving),
+          _cluster(fmt::format("localhost:{}", port), std::move(peers)),
+          _delivery_options(std::move(delivery_options)),
+          _dead_letters(dead_letter_capacity),
+          _log(log_options),
+          _offsets(log_options.directory / "offsets.json"),
+          _pulls(_log, max_pull_batch),
+          _published_messages(_delivery_options.queue_capacity),
+          _delivery_pool(num_delivery_workers, static_cast<int>(std::max<std::size_t>(_delivery_options.window, 8))),
           _deliverer_thread(&Self::deliverer, this)   
-           {}
+           {
+        scheduleMaintenance();
+    }
 
     ~Server() {
+        std::shared_ptr<const SubscriptionRegistry::Snapshot> subscribers;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            subscribers = _registry.snapshot();
+        }
+        for (const auto& queue : subscribers->queues) {
+            queue->close();
+        }
+        _published_messages.close();
         if (_deliverer_thread.joinable()) {
             _deliverer_thread.join();
         }
+        commitOffsets(subscribers->queues);
+        _log.sync();
     }
 
-    void deliverer() {
-        Http::Experimental::Client client{};
+    static constexpr auto maintenance_interval = std::chrono::seconds(1);
+    static constexpr auto peer_ping_timeout = std::chrono::milliseconds(500);
+    static constexpr std::size_t max_pull_batch = 1000;
+    static constexpr auto max_poll_timeout = std::chrono::seconds(60);
 
-        auto opts = Http::Experimental::Client::options().threads(1).maxConnectionsPerHost(1);
-        client.init(opts);
+    // Pings peers, evicts dead subscribers, persists committed offsets and applies
+    // time based retention, reschedules itself.
+    void scheduleMaintenance() {
+        _delivery_pool.submitAfter(maintenance_interval, [this](DeliveryPool::Client& client) {
+            pingPeers(client);
 
-        while (true) {
             std::unique_lock<std::mutex> lock(_m);
-            _cv.wait(lock, [this] { return !this->_published_messages.empty(); });
+            const auto expired = _registry.expire(SubscriptionRegistry::Clock::now());
+            const auto subscribers = _registry.snapshot();
+            lock.unlock();
+            for (const auto& queue : expired) {
+                logger->warn("Evicting {}, its callback keeps failing.", queue->_url);
+                queue->close();
+            }
+            try {
+                commitOffsets(expired);
+                commitOffsets(subscribers->queues);
+                _log.sync();
+                _log.expire();
+                // Expires long-polls and keeps idle streams alive.
+                if (_pulls.pump()) {
+                    requestPump();
+                }
+            } catch (const std::exception& e) {
+                logger->error("Log maintenance failed: {}", e.what());
+            }
+            scheduleMaintenance();
+        });
+    }
+    // Ring changes as peers answer or stop answering, that moves partitions between brokers.
+    void pingPeers(DeliveryPool::Client& client) {
+        for (const auto& peer : _cluster.peers()) {
+            client.get(fmt::format("{}/v1/cluster", peer)).timeout(peer_ping_timeout).send().then(
+                [this, peer](const Http::Response& response) {
+                    if (response.code() != Http::Code::Ok || !_cluster.seen(peer, Cluster::Clock::now())) {
+                        return;
+                    }
+                    logger->info("Broker {} joined, {} brokers in the ring.", peer, _cluster.ring()->brokers().size());
+                    // Joining broker needs every subscription for the partitions it takes over.
+                    std::unique_lock<std::mutex> lock(_m);
+                    const auto definitions = _registry.definitions();
+                    lock.unlock();
+                    for (const auto& definition : definitions) {
+                        auto subscription = nlohmann::json::parse(definition);
+                        subscription["from"] = "committed";
+                        common::spawn(replicate(Http::Method::Post, peer, subscription.dump()));
+                    }
+                },
+                Async::IgnoreException
+            );
+        }
+        for (const auto& peer : _cluster.expire(Cluster::Clock::now())) {
+            logger->warn("Broker {} left, {} brokers in the ring.", peer, _cluster.ring()->brokers().size());
+        }
+    }
+    // Subscriptions are kept by every broker, each one delivers what's published to its partitions.
+    common::Task<void> replicate(Http::Method method, std::string peer, std::string body) {
+        auto* client = co_await _delivery_pool.schedule();
+        if (client == nullptr) {
+            co_return;
+        }
+        const auto url = fmt::format("{}/v1/subscribe?replica=1", peer);
+        auto request = method == Http::Method::Delete ? client->del(url) : client->post(url);
+        try {
+            co_await request.body(body).timeout(_delivery_options.request_timeout).send();
+        } catch (...) {
+            logger->warn("Couldn't replicate subscription to {}: {}", peer, common::describe(std::current_exception()));
+        }
+    }
+    // Replicas are sent concurrently, done once every broker answered or failed to.
+    common::Task<void> replicateToPeers(Http::Method method, std::string body) {
+        const auto ring = _cluster.ring();
+        std::vector<Async::Promise<void>> replicas;
+        for (const auto& broker : ring->brokers()) {
+            if (broker != _cluster.self()) {
+                replicas.push_back(common::toPromise(replicate(method, broker, body)));
+            }
+        }
+        for (auto& replica : replicas) {
+            co_await std::move(replica);
+        }
+    }
+    // Answers once other brokers have the change too, so a publish to any of them right after
+    // already reaches the subscriber. Worker isn't held meanwhile, replicas answer right away.
+    // The request stays in flight for admission control until it's answered.
+    void replicateAndSend(const Rest::Request& request, Http::Method method, Http::ResponseWriter response,
+        Http::Code code, std::string text) {
+        if (request.query().has("replica")) {
+            response.send(code, text);
+            return;
+        }
+        common::spawn(replicateThenSend(method, request.body(), std::move(response), code, std::move(text), common::holdAdmission()));
+    }
+    common::Task<void> replicateThenSend(Http::Method method, std::string body, Http::ResponseWriter response,
+        Http::Code code, std::string text, common::AdmissionHold admission) {
+        co_await replicateToPeers(method, std::move(body));
+        response.send(code, text);
+        admission.reset();
+    }
+
+    void commitOffsets(const std::vector<SubscriptionRegistry::Queue>& subscribers) {
+        for (const auto& queue : subscribers) {
+            _offsets.commit(queue->_url, queue->committed());
+        }
+        _offsets.flush();
+    }
 
-            const auto& message = _published_messages.back();
-            const nlohmann::json body = message;
+    void deliverer() {
+        std::vector<SubscriptionRegistry::Queue> matching;
+        while (const auto message = _published_messages.pop()) {
+            // Serialized once, log and every subscriber queue share the same immutable body.
+            const auto body = std::make_shared<const common::EncodedBody>(nlohmann::json(*message).dump(), _delivery_options.compression);
+
+            // Appended under _m so subscribe() sees message either in the log
+            // before its starting offset or gets it pushed live, never both.
+            std::unique_lock<std::mutex> lock(_m);
+            const auto offset = _log.append(message->topic, body->identity());
+            const auto subscribers = _registry.snapshot();
+            lock.unlock();
+
+            matching.clear();
+            subscribers->routes.match(message->topic, matching);
+
+            // Only BlockPublisher policy can stall here, on purpose, backpressure
+            // then reaches publishers as 503s once _published_messages fills up.
+            for (const auto& queue : matching) {
+                if (queue->push(offset, body)) {
+                    scheduleDelivery(queue);
+                }
+            }
+            if (!_pulls.empty()) {
+                requestPump();
+            }
+        }
+    }
+
+    // At most one pump is queued, a burst of appends is picked up by a single write per consumer.
+    void requestPump() {
+        if (_pulls.requestPump()) {
+            _delivery_pool.submit([this](DeliveryPool::Client&) {
+                if (_pulls.pump()) {
+                    requestPump();
+                }
+            });
+        }
+    }
 
-            for (const auto& subscriber : _subscribers) {
-                client.post(subscriber.client_callback_url).body(body.dump()).send();
+    void scheduleDelivery(const std::shared_ptr<SubscriberQueue>& queue) {
+        auto task = [this, queue](DeliveryPool::Client& client) { fillWindow(client, queue); };
+        if (const auto linger = queue->linger(); linger.count() > 0) {
+            _delivery_pool.submitAfter(linger, std::move(task));
+        } else {
+            _delivery_pool.submit(std::move(task));
+        }
+    }
+    // Sends until subscriber's window is full, acknowledgements schedule the next fill.
+    // Every delivery waits for its subscriber without holding the worker.
+    void fillWindow(DeliveryPool::Client& client, const std::shared_ptr<SubscriberQueue>& queue) {
+        while (auto delivery = queue->next()) {
+            common::spawn(deliver(&client, queue, std::move(*delivery)));
+        }
+    }
+    // Retries with backoff until acknowledged or out of attempts, then dead-letters it.
+    common::Task<void> deliver(DeliveryPool::Client* client, std::shared_ptr<SubscriberQueue> queue, Delivery delivery) {
+        while (true) {
+            std::string reason;
+            try {
+                const auto response = co_await post(*client, *queue, delivery);
+                const auto code = static_cast<int>(response.code());
+                if (code / 100 == 2) {
+                    if (queue->release(delivery.id)) {
+                        scheduleDelivery(queue);
+                    }
+                    co_return;
+                }
+                reason = fmt::format("Subscriber responded with {}", code);
+            } catch (...) {
+                reason = common::describe(std::current_exception());
+            }
+            if (queue->closed()) {
+                co_return;
             }
+            const auto backoff = queue->failed(delivery.id);
+            if (!backoff.has_value()) {
+                logger->warn("Giving up delivery to {}: {}", queue->_url, reason);
+                _dead_letters.push({
+                    .url = queue->_url,
+                    .body = std::shared_ptr<const std::string>(delivery.body, &delivery.body->identity()),
+                    .reason = std::move(reason),
+                    .attempts = _delivery_options.max_retries + 1
+                });
+                if (queue->release(delivery.id, false)) {
+                    scheduleDelivery(queue);
+                }
+                co_return;
+            }
+            client = co_await _delivery_pool.after(*backoff);
+            if (client == nullptr) {
+                co_return;
+            }
+        }
+    }
+    Async::Promise<Http::Response> post(DeliveryPool::Client& client, const SubscriberQueue& queue, const Delivery& delivery) {
+        const auto [encoding, data] = delivery.body->encode(queue._encoding);
+        auto request = client.post(queue._url);
+        if (encoding != common::Encoding::Identity) {
+            request.header<common::ContentCoding>(encoding);
+        }
+        return request.body(data).timeout(_delivery_options.request_timeout).send();
+    }
 
-            _published_messages.pop();
+    static std::optional<uint64_t> parseOffset(std::string_view text) {
+        uint64_t offset = 0;
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), offset);
+        if (ec != std::errc{} || end != text.data() + text.size()) {
+            return std::nullopt;
         }
+        return offset;
+    }
+
+    common::Expected<uint64_t> startingOffset(const std::string& from, const std::string& url = {}) const {
+        if (from == "latest") {
+            return _log.endOffset();
+        }
+        if (from == "earliest") {
+            return _log.startOffset();
+        }
+        if (from == "committed") {
+            return _offsets.get(url).value_or(_log.endOffset());
+        }
+        if (const auto offset = parseOffset(from); offset.has_value()) {
+            return *offset;
+        }
+        return common::Error{ common::Errc::BadRequest, "Offset has to be latest, earliest, committed or a number" };
+    }
+
+    // Reconnecting EventSource resumes right after the last event it saw.
+    common::Expected<uint64_t> streamOffset(const Rest::Request& request) const {
+        const auto last_event_id = request.headers().tryGetRaw("Last-Event-ID");
+        if (!last_event_id.has_value()) {
+            return startingOffset(request.query().get("offset").value_or("latest"));
+        }
+        const auto last = parseOffset(last_event_id->value());
+        if (!last.has_value()) {
+            return common::Error{ common::Errc::BadRequest, "Last-Event-ID has to be a number" };
+        }
+        return *last + 1;
+    }
+
+    // Comma separated, '#' has to come percent-encoded as it otherwise starts the fragment.
+    static common::Expected<TopicFilter> topicsParam(const Rest::Request& request) {
+        std::vector<std::string> topics;
+        const auto param = request.query().get("topics");
+        if (param.has_value()) {
+            std::string decoded;
+            for (std::size_t i = 0; i < param->size(); ++i) {
+                if ((*param)[i] == '%' && i + 2 < param->size()) {
+                    unsigned char byte = 0;
+                    const auto escape = param->data() + i + 1;
+                    const auto [end, ec] = std::from_chars(escape, escape + 2, byte, 16);
+                    if (ec != std::errc{} || end != escape + 2) {
+                        return common::Error{ common::Errc::BadRequest, "Malformed percent-encoding in topics" };
+                    }
+                    decoded += static_cast<char>(byte);
+                    i += 2;
+                } else {
+                    decoded += (*param)[i];
+                }
+            }
+            std::size_t begin = 0;
+            while (begin <= decoded.size()) {
+                const auto end = std::min(decoded.find(',', begin), decoded.size());
+                if (end > begin) {
+                    topics.push_back(decoded.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+        }
+        if (topics.empty()) {
+            topics.push_back("#");
+        }
+        return TopicFilter(topics);
     }
 
     void subscribe(const Rest::Request& request, Http::ResponseWriter response) {
@@ -112,10 +405,80 @@ struct Server {
 
             logger->info("Received subscription request from {}.", subscription.client_callback_url); 
             
-            std::lock_guard<std::mutex> lock(_m);
-            _subscribers.push_back(std::move(subscription));
+            auto topics = SubscriptionRegistry::normalize(subscription.topics);
+            const auto now = SubscriptionRegistry::Clock::now();
+
+            std::unique_lock<std::mutex> lock(_m);
+            // Repeated subscription only renews the lease, changed topics or
+            // delivery options replace the queue.
+            if (auto* registration = _registry.find(subscription.client_callback_url);
+                registration != nullptr && registration->topics == topics
+                && ns::sameDelivery(nlohmann::json::parse(registration->definition).template get<ns::Subscription>(), subscription)) {
+                registration->lease = std::chrono::milliseconds(subscription.lease_ms);
+                registration->renewed = now;
+                lock.unlock();
+                replicateAndSend(request, Http::Method::Post, std::move(response), Http::Code::Ok, "Already subscribed!!");
+                return;
+            }
+            const auto from = startingOffset(subscription.from, subscription.client_callback_url);
+            if (!from) {
+                lock.unlock();
+                common::sendError(response, from.error());
+                return;
+            }
+            const auto queue = std::make_shared<SubscriberQueue>(
+                subscription.client_callback_url,
+                _delivery_options,
+                _log,
+                topics,
+                *from,
+                BatchOptions{
+                    .max_messages = subscription.batch_size,
+                    .linger = std::chrono::milliseconds(subscription.linger_ms)
+                },
+                subscription.window > 0 ? subscription.window : _delivery_options.window,
+                common::negotiate(subscription.accept_encoding)
+            );
+            const auto replaced = _registry.put(subscription.client_callback_url, {
+                .queue = queue,
+                .topics = std::move(topics),
+                .lease = std::chrono::milliseconds(subscription.lease_ms),
+                .renewed = now,
+                .definition = nlohmann::json(subscription).dump()
+            });
+            if (replaced != nullptr) {
+                replaced->close();
+            }
+            lock.unlock();
+
+            replicateAndSend(request, Http::Method::Post, std::move(response),
+                Http::Code::Ok, replaced != nullptr ? "Subscription updated!!" : "Subscribed!!");
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+    void unsubscribe(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto url = nlohmann::json::parse(request.body()).at("client_callback_url").template get<std::string>();
 
-            response.send(Http::Code::Ok, "Subscribed!!");
+            std::unique_lock<std::mutex> lock(_m);
+            const auto queue = _registry.erase(url);
+            lock.unlock();
+
+            if (queue == nullptr) {
+                replicateAndSend(request, Http::Method::Delete, std::move(response), Http::Code::Not_Found, "Not subscribed!");
+                return;
+            }
+            queue->close();
+            // Kept so subscriber can come back from where it left off.
+            _offsets.commit(url, queue->committed());
+
+            logger->info("Unsubscribed {}.", url);
+            replicateAndSend(request, Http::Method::Delete, std::move(response), Http::Code::Ok, "Unsubscribed!!");
         } catch (const std::exception& e) {
             response.send(
                 Pistache::Http::Code::Internal_Server_Error,
@@ -131,14 +494,27 @@ struct Server {
                     fmt::format("Wrong MIME type, only JSON accepted, passed {}", MIME(Application, Json).toString())
                 );
             }
-            const auto message = nlohmann::json::parse(request.body()).template get<ns::Message>();
+            auto message = nlohmann::json::parse(request.body()).template get<ns::Message>();
             
-            logger->info("Received message to publish from {}.", message.author); 
+            // Redirected once at most, brokers briefly disagreeing on the ring mustn't bounce it around.
+            if (const auto owner = _cluster.owner(message.topic); owner != _cluster.self() && !request.query().has("redirected")) {
+                response.headers().add<Http::Header::Location>(fmt::format("http://{}/v1/publish?redirected=1", owner));
+                response.send(Http::Code::Temporary_Redirect, fmt::format("Topic is owned by {}", owner));
+                return;
+            }
 
-            std::lock_guard<std::mutex> lock(_m);
-            _published_messages.push(std::move(message));
+            logger->info("Received message to publish from {}.", message.author); 
 
-            _cv.notify_one();
+            if (_published_messages.closed()) {
+                response.send(Http::Code::Service_Unavailable, "Server is shutting down!");
+                return;
+            }
+            // Lock-free. A full queue means the deliverer is behind, the publisher
+            // is told to come back later rather than holding a reactor thread.
+            if (!_published_messages.tryPush(std::move(message))) {
+                common::refuse(response, Http::Code::Service_Unavailable, std::chrono::seconds(1), "Publish queue is full");
+                return;
+            }
             
             response.send(Http::Code::Ok, "Published!!");
         } catch (const std::exception& e) {
@@ -150,8 +526,179 @@ struct Server {
         }
     }
 
+    void poll(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto from = startingOffset(request.query().get("offset").value_or("latest"));
+            if (!from) {
+                common::sendError(response, from.error());
+                return;
+            }
+            const auto max_messages = common::numberQuery(request, "max", 100);
+            if (!max_messages) {
+                common::sendError(response, max_messages.error());
+                return;
+            }
+            const auto timeout_ms = common::numberQuery(request, "timeout_ms", 30000);
+            if (!timeout_ms) {
+                common::sendError(response, timeout_ms.error());
+                return;
+            }
+            auto filter = topicsParam(request);
+            if (!filter) {
+                common::sendError(response, filter.error());
+                return;
+            }
+            const auto timeout = std::chrono::milliseconds(
+                std::min<uint64_t>(*timeout_ms, std::chrono::milliseconds(max_poll_timeout).count())
+            );
+
+            _delivery_pool.submitAfter(timeout, [this](DeliveryPool::Client&) {
+                if (_pulls.pump()) {
+                    requestPump();
+                }
+            });
+            // Last, the writer is the hub's from here on. A record appended while
+            // the poll was being parked is picked up by a pump right after.
+            if (_pulls.poll(std::move(response), std::move(*filter), *from, *max_messages, timeout)) {
+                requestPump();
+            }
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void stream(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const auto from = streamOffset(request);
+            if (!from) {
+                common::sendError(response, from.error());
+                return;
+            }
+            auto filter = topicsParam(request);
+            if (!filter) {
+                common::sendError(response, filter.error());
+                return;
+            }
+
+            response.headers()
+                .add<Http::Header::ContentType>(Http::Mime::MediaType::fromString("text/event-stream"))
+                .addRaw(Http::Header::Raw("Cache-Control", "no-cache"));
+            _pulls.stream(response.stream(Http::Code::Ok), std::move(*filter), *from);
+            requestPump();
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void deadLetters(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            nlohmann::json result = nlohmann::json::array();
+            for (const auto& letter : _dead_letters.snapshot()) {
+                result.push_back({
+                    {"client_callback_url", letter.url},
+                    {"message", nlohmann::json::parse(*letter.body)},
+                    {"reason", letter.reason},
+                    {"attempts", letter.attempts}
+                });
+            }
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void offsets(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            std::unique_lock<std::mutex> lock(_m);
+            const auto subscribers = _registry.snapshot();
+            lock.unlock();
+
+            nlohmann::json committed = nlohmann::json::array();
+            for (const auto& queue : subscribers->queues) {
+                committed.push_back({
+                    {"client_callback_url", queue->_url},
+                    {"committed_offset", queue->committed()}
+                });
+            }
+            const nlohmann::json result{
+                {"start_offset", _log.startOffset()},
+                {"end_offset", _log.endOffset()},
+                {"subscribers", std::move(committed)}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void cluster(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            const nlohmann::json result{
+                {"self", _cluster.self()},
+                {"brokers", _cluster.ring()->brokers()}
+            };
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
+    void subscribers(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            std::unique_lock<std::mutex> lock(_m);
+            const auto snapshot = _registry.snapshot();
+            lock.unlock();
+
+            nlohmann::json result = nlohmann::json::array();
+            for (const auto& queue : snapshot->queues) {
+                const auto stats = queue->stats();
+                result.push_back({
+                    {"client_callback_url", queue->_url},
+                    {"committed_offset", queue->committed()},
+                    {"window", stats.window},
+                    {"in_flight", stats.in_flight},
+                    {"pending", stats.pending},
+                    {"dropped", stats.dropped},
+                    {"latency", {
+                        {"acknowledged", stats.latency.count},
+                        {"mean_ms", stats.latency.meanMs()},
+                        {"ewma_ms", stats.latency.ewma_ms},
+                        {"max_ms", static_cast<double>(stats.latency.max.count()) / 1000.0}
+                    }}
+                });
+            }
+            response.send(Http::Code::Ok, result.dump(), MIME(Application, Json));
+        } catch (const std::exception& e) {
+            response.send(
+                Pistache::Http::Code::Internal_Server_Error,
+                fmt::format("Internal error: {}", e.what()),
+                MIME(Text, Plain)
+            );
+        }
+    }
+
     void init() {
-        _end_point->init(Http::Endpoint::options().threads(_num_threads));
+        _end_points.init(Http::Endpoint::options());
 
         describe();
 
@@ -164,11 +711,11 @@ struct Server {
             .serializer(&Rest::Serializer::rapidJson)
             .install(_router);
 
-        _end_point->setHandler(_router.handler());
+        _end_points.setHandler(_router.handler());
     }
     void run() {
-        logger->info("Server started on port {} with {} threads", _port, _num_threads);
-        _end_point->serve();
+        logger->info("Server started on port {} with {} listeners of {} threads", _port, _serving.listeners, _serving.threads);
+        _end_points.serve();
     }
     void describe() {
         _desc.info().license("Apache", "http://www.apache.org/licenses/LICENSE-2.0");
@@ -184,22 +731,93 @@ struct Server {
             .response(Http::Code::Ok, "Subscribed!")
             .response(Http::Code::Internal_Server_Error, "Couldn't subsribe!");
 
+        version_path.route(_desc.del("/subscribe")).bind(&Self::unsubscribe, this)
+            .consumes(MIME(Application, Json))
+            .response(Http::Code::Ok, "Unsubscribed!")
+            .response(Http::Code::Not_Found, "No such subscriber!")
+            .response(Http::Code::Internal_Server_Error, "Couldn't unsubsribe!");
+
         version_path.route(_desc.post("/publish")).bind(&Self::publish, this)
             .consumes(MIME(Application, Json))
             .response(Http::Code::Ok, "Message published!")
+            .response(Http::Code::Temporary_Redirect, "Topic is owned by another broker, see Location.")
             .response(Http::Code::Internal_Server_Error, "Couldn't publish!");
+
+        version_path.route(_desc.get("/poll")).bind(&Self::poll, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Messages from given offset, waits for them up to timeout_ms.")
+            .response(Http::Code::Bad_Request, "Malformed offset, max, timeout_ms or topics.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't poll!");
+
+        version_path.route(_desc.get("/stream")).bind(&Self::stream, this)
+            .response(Http::Code::Ok, "Server-Sent Events stream of messages.")
+            .response(Http::Code::Bad_Request, "Malformed offset, Last-Event-ID or topics.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't open stream!");
+
+        version_path.route(_desc.get("/dead-letters")).bind(&Self::deadLetters, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Messages which couldn't be delivered.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't list dead letters!");
+
+        version_path.route(_desc.get("/cluster")).bind(&Self::cluster, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Brokers currently in the ring.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't list brokers!");
+
+        version_path.route(_desc.get("/subscribers")).bind(&Self::subscribers, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Delivery window and latency of every subscriber.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't list subscribers!");
+
+        version_path.route(_desc.get("/offsets")).bind(&Self::offsets, this)
+            .produces(MIME(Application, Json))
+            .response(Http::Code::Ok, "Log bounds and committed offset of every subscriber.")
+            .response(Http::Code::Internal_Server_Error, "Couldn't list offsets!");
     }
 };
 
 int main(int argc, char** argv) {
     CLI::App app("Server pub/sub app");
     int port = 0;
+    uint delivery_workers = std::thread::hardware_concurrency();
     app.add_option("-o,--port", port, "Server port.");
+    app.add_option("-w,--delivery-workers", delivery_workers, "Number of threads fanning out published messages.");
+
+    common::ServingOptions serving{ .threads = 2 };
+    common::addServingOptions(app, serving);
+
+    std::vector<std::string> peers;
+    app.add_option("--peers", peers, "Other brokers (host:port) topics are partitioned with.")->delimiter(',');
+
+    DeliveryOptions delivery_options;
+    std::size_t dead_letter_capacity = 1024;
+    const std::map<std::string, OverflowPolicy> overflow_policies{
+        {"drop-oldest", OverflowPolicy::DropOldest},
+        {"block", OverflowPolicy::BlockPublisher},
+        {"spill", OverflowPolicy::SpillToDisk}
+    };
+    app.add_option("-q,--queue-capacity", delivery_options.queue_capacity, "Messages buffered per subscriber.");
+    app.add_option("--overflow", delivery_options.overflow_policy, "What to do when subscriber's queue is full.")
+        ->transform(CLI::CheckedTransformer(overflow_policies, CLI::ignore_case));
+    app.add_option("--window", delivery_options.window, "Deliveries in flight per subscriber, 1 keeps strict ordering.");
+    app.add_option("-r,--max-retries", delivery_options.max_retries, "Delivery retries before message is dead-lettered.");
+    app.add_option("--spill-dir", delivery_options.spill_directory, "Directory for messages spilled to disk.");
+    app.add_option("--compress-threshold", delivery_options.compression.threshold, "Bodies above this many bytes are compressed for subscribers accepting it.");
+    app.add_option("--dead-letters", dead_letter_capacity, "Number of dead letters kept.");
+
+    LogOptions log_options;
+    uint retention_hours = 7 * 24;
+    app.add_option("--log-dir", log_options.directory, "Directory of the durable message log.");
+    app.add_option("--segment-bytes", log_options.segment_bytes, "Size of a single log segment.");
+    app.add_option("--retention-bytes", log_options.retention_bytes, "Log size above which oldest segments are removed.");
+    app.add_option("--retention-hours", retention_hours, "Age after which log segments are removed.");
 
     CLI11_PARSE(app, argc, argv);
 
+    log_options.retention_time = std::chrono::hours(retention_hours);
+
     try {
-        Server server(port, 2);
+        Server server(port, serving, delivery_workers, std::move(delivery_options), dead_letter_capacity, std::move(log_options), std::move(peers));
         server.init();
         server.run();
     }
@@ -2,14 +2,86 @@
 #define LAB13_SHARED_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+namespace ns {
 
 struct Message {
     std::string author;
     std::string contents;
+    // '.' separated levels, eg. "orders.eu.created".
+    std::string topic;
 };
 
 struct Subscription {
     std::string client_callback_url;
+    // Topics or patterns ('*' one level, '#' all remaining levels), everything if empty.
+    std::vector<std::string> topics;
+    // Offset to start from: "latest", "earliest", "committed" or a number.
+    std::string from = "latest";
+    // Batching is off unless batch_size > 1, then messages are POSTed as arrays.
+    std::size_t batch_size = 0;
+    uint linger_ms = 0;
+    // Subscriber whose callback keeps failing for longer than this (and who
+    // doesn't re-subscribe meanwhile) is evicted.
+    uint lease_ms = 60'000;
+    // Deliveries in flight at once, server's default if 0.
+    std::size_t window = 0;
+    // Accept-Encoding style list ("zstd, gzip") of codings the inbox can decode, none if empty.
+    std::string accept_encoding;
 };
 
+// Same queue serves both, they differ at most in the lease a resubscription renews.
+// Topics aren't compared here, the registry keeps them normalized for that.
+inline bool sameDelivery(const Subscription& l, const Subscription& r) {
+    return l.client_callback_url == r.client_callback_url
+        && l.from == r.from
+        && l.batch_size == r.batch_size
+        && l.linger_ms == r.linger_ms
+        && l.window == r.window
+        && l.accept_encoding == r.accept_encoding;
+}
+
+inline void to_json(nlohmann::json& j, const Message& m) {
+    j = nlohmann::json{
+        {"author", m.author},
+        {"contents", m.contents},
+        {"topic", m.topic}
+    };
+}
+inline void from_json(const nlohmann::json& j, Message& m) {
+    j.at("author").get_to(m.author);
+    j.at("contents").get_to(m.contents);
+    m.topic = j.value("topic", std::string{});
+}
+inline void to_json(nlohmann::json& j, const Subscription& s) {
+    j = nlohmann::json{
+        {"client_callback_url", s.client_callback_url},
+        {"topics", s.topics},
+        {"from", s.from},
+        {"batch_size", s.batch_size},
+        {"linger_ms", s.linger_ms},
+        {"lease_ms", s.lease_ms},
+        {"window", s.window},
+        {"accept_encoding", s.accept_encoding},
+    };
+}
+inline void from_json(const nlohmann::json& j, Subscription& s) {
+    j.at("client_callback_url").get_to(s.client_callback_url);
+    s.topics = j.value("topics", std::vector<std::string>{});
+    if (const auto from = j.find("from"); from != j.end()) {
+        s.from = from->is_number() ? std::to_string(from->template get<uint64_t>()) : from->template get<std::string>();
+    }
+    s.batch_size = j.value("batch_size", std::size_t{ 0 });
+    s.linger_ms = j.value("linger_ms", 0U);
+    s.lease_ms = j.value("lease_ms", s.lease_ms);
+    s.window = j.value("window", std::size_t{ 0 });
+    s.accept_encoding = j.value("accept_encoding", std::string{});
+}
+
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,423 @@
+#ifndef LAB13_SUBSCRIBER_QUEUE_H
+#define LAB13_SUBSCRIBER_QUEUE_H
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "common/compression.h"
+
+#include "message_log.h"
+#include "topic_index.h"
+
+enum class OverflowPolicy {
+    DropOldest,
+    BlockPublisher,
+    SpillToDisk
+};
+
+struct DeliveryOptions {
+    std::size_t queue_capacity = 1024;
+    OverflowPolicy overflow_policy = OverflowPolicy::DropOldest;
+    uint max_retries = 5;
+    std::chrono::milliseconds initial_backoff{ 100 };
+    std::chrono::milliseconds max_backoff{ 10'000 };
+    std::chrono::milliseconds request_timeout{ 5'000 };
+    // Deliveries in flight per subscriber unless it asks for its own window.
+    std::size_t window = 8;
+    std::filesystem::path spill_directory{ "spill" };
+    // Applies to bodies of subscribers which declared accept_encoding.
+    common::CompressionOptions compression;
+
+    std::chrono::milliseconds backoff(uint attempt) const {
+        const auto shift = std::min(attempt, 16U);
+        return std::min<std::chrono::milliseconds>(initial_backoff * (1LL << shift), max_backoff);
+    }
+};
+
+// Opt-in per subscriber. Queued bodies are coalesced into a single JSON array,
+// a batch is sent once it is full or once it lingered long enough.
+struct BatchOptions {
+    std::size_t max_messages = 0;
+    std::chrono::milliseconds linger{ 0 };
+
+    bool enabled() const noexcept {
+        return max_messages > 1;
+    }
+};
+
+// Serialized once per message, compressed at most once per encoding however many subscribers get it.
+using Body = std::shared_ptr<const common::EncodedBody>;
+
+struct Entry {
+    uint64_t offset;
+    Body body;
+};
+
+// Single body (or batch) handed out for sending, id is used to acknowledge it.
+struct Delivery {
+    uint64_t id;
+    Body body;
+};
+
+// Time from the first send of a delivery to its acknowledgement, retries included.
+struct LatencyStats {
+    uint64_t count = 0;
+    std::chrono::microseconds total{ 0 };
+    std::chrono::microseconds max{ 0 };
+    double ewma_ms = 0;
+
+    void record(std::chrono::microseconds latency) {
+        constexpr double alpha = 0.1;
+        const double ms = static_cast<double>(latency.count()) / 1000.0;
+        ewma_ms = count == 0 ? ms : alpha * ms + (1 - alpha) * ewma_ms;
+        ++count;
+        total += latency;
+        max = std::max(max, latency);
+    }
+    double meanMs() const noexcept {
+        return count == 0 ? 0 : static_cast<double>(total.count()) / 1000.0 / static_cast<double>(count);
+    }
+};
+
+struct QueueStats {
+    std::size_t window;
+    std::size_t in_flight;
+    std::size_t pending;
+    std::size_t dropped;
+    LatencyStats latency;
+};
+
+// Append-only file of offset and length prefixed bodies read back in FIFO order. Truncated
+// every time reader catches up with writer so it doesn't grow forever.
+struct SpillFile {
+    std::filesystem::path _path;
+    std::fstream _file;
+    std::streamoff _read_offset{ 0 };
+    std::size_t _records{ 0 };
+
+    explicit SpillFile(std::filesystem::path path) : _path(std::move(path)) {
+        std::filesystem::create_directories(_path.parent_path());
+        reopen();
+    }
+    ~SpillFile() {
+        _file.close();
+        std::error_code ec;
+        std::filesystem::remove(_path, ec);
+    }
+
+    bool empty() const noexcept {
+        return _records == 0;
+    }
+    void push(uint64_t offset, const std::string& body) {
+        const auto size = static_cast<uint32_t>(body.size());
+        _file.seekp(0, std::ios::end);
+        _file.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+        _file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        _file.write(body.data(), static_cast<std::streamsize>(body.size()));
+        ++_records;
+    }
+    std::pair<uint64_t, std::string> pop() {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        _file.seekg(_read_offset);
+        _file.read(reinterpret_cast<char*>(&offset), sizeof(offset));
+        _file.read(reinterpret_cast<char*>(&size), sizeof(size));
+        std::string body(size, '\0');
+        _file.read(body.data(), size);
+        _read_offset += static_cast<std::streamoff>(sizeof(offset) + sizeof(size) + size);
+
+        if (--_records == 0) {
+            reopen();
+        }
+        return { offset, std::move(body) };
+    }
+
+private:
+    void reopen() {
+        _file.close();
+        _file.open(_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!_file) {
+            throw std::runtime_error(fmt::format("Couldn't open spill file {}", _path.string()));
+        }
+        _read_offset = 0;
+    }
+};
+
+// Delivery queue of a single subscriber. Up to _window bodies (or batches) are
+// in flight at once, committed offset only moves past the oldest of them once
+// they are acknowledged (or dead-lettered), so delivery is at-least-once. Order
+// is kept for window of 1, wider windows may reorder retried deliveries.
+// Subscribers starting from an older offset first replay the log, live pushes
+// are ignored until replay catches up (they are in the log anyway).
+struct SubscriberQueue {
+    using Clock = std::chrono::steady_clock;
+
+    struct InFlight {
+        uint64_t id;
+        // Offset right after the last message in the body.
+        uint64_t end;
+        Clock::time_point sent;
+        uint attempt{ 0 };
+        bool done{ false };
+    };
+
+    std::string _url;
+    const DeliveryOptions& _options;
+    BatchOptions _batch;
+    std::size_t _window;
+    common::Encoding _encoding;
+    const MessageLog& _log;
+    TopicFilter _filter;
+
+    std::deque<Entry> _pending;
+    std::optional<SpillFile> _spill;
+    // In send order, front is the oldest unacknowledged delivery.
+    std::deque<InFlight> _in_flight;
+    uint64_t _next_id{ 0 };
+    bool _scheduled{ false };
+    bool _closed{ false };
+    std::size_t _dropped{ 0 };
+    std::optional<Clock::time_point> _failing_since;
+    LatencyStats _latency;
+
+    bool _replaying;
+    uint64_t _replay_next;
+    uint64_t _latest;
+    std::atomic<uint64_t> _committed;
+
+    std::mutex _m;
+    std::condition_variable _space_cv;
+
+    SubscriberQueue(
+        std::string url,
+        const DeliveryOptions& options,
+        const MessageLog& log,
+        const std::vector<std::string>& topics,
+        uint64_t from_offset,
+        BatchOptions batch = {},
+        std::size_t window = 1,
+        common::Encoding encoding = common::Encoding::Identity
+    )
+        : _url(std::move(url)),
+          _options(options),
+          _batch(batch),
+          _window(std::max<std::size_t>(window, 1)),
+          _encoding(encoding),
+          _log(log),
+          _filter(topics),
+          _latest(log.endOffset()),
+          _committed(from_offset) {
+        _replay_next = std::max(from_offset, log.startOffset());
+        _replaying = _replay_next < _latest;
+    }
+
+    // Returns true when queue was idle, caller has to schedule a delivery then.
+    bool push(uint64_t offset, Body body) {
+        std::unique_lock<std::mutex> lock(_m);
+        if (_closed) {
+            return false;
+        }
+        _latest = offset + 1;
+        if (_replaying) {
+            return schedule();
+        }
+        const bool spilling = _spill.has_value() && !_spill->empty();
+        if (spilling || _pending.size() >= _options.queue_capacity) {
+            switch (_options.overflow_policy) {
+            case OverflowPolicy::DropOldest:
+                if (!_pending.empty()) {
+                    _pending.pop_front();
+                    ++_dropped;
+                }
+                break;
+            case OverflowPolicy::BlockPublisher:
+                _space_cv.wait(lock, [this] { return _closed || _pending.size() < _options.queue_capacity; });
+                if (_closed) {
+                    return false;
+                }
+                break;
+            case OverflowPolicy::SpillToDisk:
+                if (!_spill.has_value()) {
+                    _spill.emplace(_options.spill_directory / fmt::format("{:016x}.spill", std::hash<std::string>{}(_url)));
+                }
+                _spill->push(offset, body->identity());
+                return schedule();
+            }
+        }
+        _pending.push_back({ offset, std::move(body) });
+        return schedule();
+    }
+
+    // Next delivery to send, nullopt when window is full or nothing is left. Queue
+    // goes idle then until push() or release() asks for another delivery. Only the
+    // single scheduled filler calls this.
+    std::optional<Delivery> next() {
+        std::unique_lock<std::mutex> lock(_m);
+        while (true) {
+            if (_closed || _in_flight.size() >= _window) {
+                _scheduled = false;
+                return std::nullopt;
+            }
+
+            const auto limit = _batch.enabled() ? _batch.max_messages : 1;
+            std::vector<Entry> entries;
+            if (_replaying) {
+                // Only the filler touches replay cursor, log is read unlocked.
+                lock.unlock();
+                _replay_next = _log.read(_replay_next, [&](const LogRecord& record) {
+                    if (_filter.matches(record.topic)) {
+                        entries.push_back({ record.offset, std::make_shared<const common::EncodedBody>(std::string(record.payload), _options.compression) });
+                    }
+                    return entries.size() < limit;
+                });
+                lock.lock();
+                if (entries.size() < limit && _replay_next >= _latest) {
+                    _replaying = false;
+                }
+            }
+            while (entries.size() < limit && !_pending.empty()) {
+                entries.push_back(std::move(_pending.front()));
+                _pending.pop_front();
+            }
+            while (_spill.has_value() && !_spill->empty() && _pending.size() < _options.queue_capacity) {
+                auto [offset, body] = _spill->pop();
+                _pending.push_back({ offset, std::make_shared<const common::EncodedBody>(std::move(body), _options.compression) });
+            }
+            _space_cv.notify_all();
+
+            if (!entries.empty()) {
+                const auto id = _next_id++;
+                _in_flight.push_back({ .id = id, .end = entries.back().offset + 1, .sent = Clock::now() });
+                return Delivery{ id, _batch.enabled() ? concatenate(entries) : std::move(entries.front().body) };
+            }
+            // Otherwise every replayed record so far was filtered out, keep going.
+            if (!_replaying) {
+                _scheduled = false;
+                return std::nullopt;
+            }
+        }
+    }
+
+    // How long to wait before sending so a batch can fill up.
+    std::chrono::milliseconds linger() {
+        std::lock_guard<std::mutex> lock(_m);
+        if (!_batch.enabled() || _replaying || _pending.size() >= _batch.max_messages) {
+            return std::chrono::milliseconds(0);
+        }
+        return _batch.linger;
+    }
+
+    // Marks delivery acknowledged (or dead-lettered) and slides the window over
+    // the done prefix. Returns true when that let an idle queue go on, caller
+    // has to schedule a delivery then.
+    bool release(uint64_t id, bool delivered = true) {
+        std::lock_guard<std::mutex> lock(_m);
+        const auto it = findInFlight(id);
+        if (it == _in_flight.end()) {
+            return false;
+        }
+        it->done = true;
+        if (delivered) {
+            _latency.record(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - it->sent));
+            _failing_since.reset();
+        }
+        while (!_in_flight.empty() && _in_flight.front().done) {
+            _committed.store(_in_flight.front().end, std::memory_order_relaxed);
+            _in_flight.pop_front();
+        }
+        return !_closed && _in_flight.size() < _window && schedule();
+    }
+
+    // Returns backoff to wait before resending or nullopt when retries are exhausted.
+    std::optional<std::chrono::milliseconds> failed(uint64_t id) {
+        std::lock_guard<std::mutex> lock(_m);
+        if (!_failing_since.has_value()) {
+            _failing_since = Clock::now();
+        }
+        const auto it = findInFlight(id);
+        if (it == _in_flight.end() || it->attempt >= _options.max_retries) {
+            return std::nullopt;
+        }
+        return _options.backoff(it->attempt++);
+    }
+
+    QueueStats stats() {
+        std::lock_guard<std::mutex> lock(_m);
+        return { _window, _in_flight.size(), _pending.size(), _dropped, _latency };
+    }
+
+    // Offset of the next message this subscriber hasn't acknowledged yet.
+    uint64_t committed() const noexcept {
+        return _committed.load(std::memory_order_relaxed);
+    }
+
+    // For how long no delivery succeeded while some failed, zero for healthy subscriber.
+    Clock::duration failingFor(Clock::time_point now) {
+        std::lock_guard<std::mutex> lock(_m);
+        return _failing_since.has_value() ? now - *_failing_since : Clock::duration::zero();
+    }
+
+    bool closed() {
+        std::lock_guard<std::mutex> lock(_m);
+        return _closed;
+    }
+
+    // Spill file goes away right here, a replacing queue of the same subscriber may reuse its path.
+    void close() {
+        std::lock_guard<std::mutex> lock(_m);
+        _closed = true;
+        _pending.clear();
+        _spill.reset();
+        _space_cv.notify_all();
+    }
+
+private:
+    std::deque<InFlight>::iterator findInFlight(uint64_t id) {
+        // Ids are handed out in order, window is short.
+        return std::find_if(_in_flight.begin(), _in_flight.end(), [id](const auto& delivery) { return delivery.id == id; });
+    }
+
+    // Bodies are already serialized, batch is just their concatenation.
+    Body concatenate(const std::vector<Entry>& entries) {
+        std::size_t size = 2 + entries.size();
+        for (const auto& entry : entries) {
+            size += entry.body->identity().size();
+        }
+        std::string batch;
+        batch.reserve(size);
+        batch.push_back('[');
+        for (const auto& entry : entries) {
+            if (batch.size() != 1) {
+                batch.push_back(',');
+            }
+            batch.append(entry.body->identity());
+        }
+        batch.push_back(']');
+        return std::make_shared<const common::EncodedBody>(std::move(batch), _options.compression);
+    }
+
+    bool schedule() {
+        if (_scheduled) {
+            return false;
+        }
+        _scheduled = true;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef LAB13_SUBSCRIPTION_REGISTRY_H
+#define LAB13_SUBSCRIPTION_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+
+#include "subscriber_queue.h"
+#include "topic_index.h"
+
+// Subscriptions by callback URL, each with a deduplicated set of topic patterns.
+// Not synchronized on its own, mutations go under the server's lock while
+// readers only take the immutable snapshot rebuilt after every change.
+struct SubscriptionRegistry {
+    using Clock = SubscriberQueue::Clock;
+    using Queue = std::shared_ptr<SubscriberQueue>;
+
+    struct Registration {
+        Queue queue;
+        std::vector<std::string> topics;
+        Clock::duration lease;
+        Clock::time_point renewed;
+        // Subscription JSON it was created from, replayed to brokers joining the cluster.
+        std::string definition;
+    };
+
+    // Queues are contiguous so periodic sweeps over them stay cheap.
+    struct Snapshot {
+        std::vector<Queue> queues;
+        TopicIndex<Queue> routes;
+    };
+
+    std::unordered_map<std::string, Registration> _registrations;
+    std::shared_ptr<const Snapshot> _snapshot{ std::make_shared<const Snapshot>() };
+
+    // Sorted and deduplicated so equal sets compare equal, everything if empty.
+    static std::vector<std::string> normalize(std::vector<std::string> topics) {
+        if (topics.empty()) {
+            topics.push_back("#");
+        }
+        std::sort(topics.begin(), topics.end());
+        topics.erase(std::unique(topics.begin(), topics.end()), topics.end());
+        return topics;
+    }
+
+    Registration* find(const std::string& url) {
+        const auto it = _registrations.find(url);
+        return it == _registrations.end() ? nullptr : &it->second;
+    }
+
+    // Returns queue it replaced, null for a new subscriber.
+    Queue put(const std::string& url, Registration registration) {
+        Queue replaced;
+        if (auto* current = find(url); current != nullptr) {
+            replaced = std::move(current->queue);
+            *current = std::move(registration);
+        } else {
+            _registrations.emplace(url, std::move(registration));
+        }
+        rebuild();
+        return replaced;
+    }
+
+    // Returns removed queue, null if there was no such subscriber.
+    Queue erase(const std::string& url) {
+        const auto it = _registrations.find(url);
+        if (it == _registrations.end()) {
+            return nullptr;
+        }
+        auto queue = std::move(it->second.queue);
+        _registrations.erase(it);
+        rebuild();
+        return queue;
+    }
+
+    // Subscribers failing for longer than their lease and not renewed since, removed from registry.
+    std::vector<Queue> expire(Clock::time_point now) {
+        std::vector<Queue> expired;
+        std::erase_if(_registrations, [&](auto& entry) {
+            auto& registration = entry.second;
+            const auto failing = registration.queue->failingFor(now);
+            if (failing <= registration.lease || now - registration.renewed <= registration.lease) {
+                return false;
+            }
+            expired.push_back(std::move(registration.queue));
+            return true;
+        });
+        if (!expired.empty()) {
+            rebuild();
+        }
+        return expired;
+    }
+
+    std::vector<std::string> definitions() const {
+        std::vector<std::string> result;
+        result.reserve(_registrations.size());
+        for (const auto& [url, registration] : _registrations) {
+            result.push_back(registration.definition);
+        }
+        return result;
+    }
+
+    std::shared_ptr<const Snapshot> snapshot() const {
+        return _snapshot;
+    }
+
+private:
+    // Rebuilt from scratch, subscribe and unsubscribe are rare next to publishing.
+    void rebuild() {
+        auto snapshot = std::make_shared<Snapshot>();
+        snapshot->queues.reserve(_registrations.size());
+        std::vector<std::pair<std::string, Queue>> routes;
+        for (const auto& [url, registration] : _registrations) {
+            snapshot->queues.push_back(registration.queue);
+            for (const auto& topic : registration.topics) {
+                routes.emplace_back(topic, registration.queue);
+            }
+        }
+        snapshot->routes = TopicIndex<Queue>::build(routes);
+        _snapshot = std::move(snapshot);
+    }
+};
+
+#endif
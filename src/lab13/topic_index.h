@@ -0,0 +1,161 @@
+#ifndef LAB13_TOPIC_INDEX_H
+#define LAB13_TOPIC_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+
+// Topic -> subscribers trie. Topics are '.' separated levels, patterns may use
+// '*' for exactly one level and '#' (only as last level) for any number of
+// remaining levels, eg. "orders.*.created" or "orders.#".
+// Index is immutable, `with` copies only the path to the changed node so
+// readers keep using their snapshot while subscriptions are added.
+template<typename Subscriber>
+struct TopicIndex {
+    // Lets levels be looked up by string_view without allocating.
+    struct LevelHash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view level) const noexcept {
+            return std::hash<std::string_view>{}(level);
+        }
+    };
+    struct Node {
+        std::unordered_map<std::string, std::shared_ptr<const Node>, LevelHash, std::equal_to<>> children;
+        std::vector<Subscriber> subscribers;
+        std::vector<Subscriber> rest;
+    };
+
+    std::shared_ptr<const Node> _root{ std::make_shared<const Node>() };
+
+    static std::vector<std::string_view> split(std::string_view topic) {
+        std::vector<std::string_view> levels;
+        if (topic.empty()) {
+            return levels;
+        }
+        std::size_t begin = 0;
+        while (true) {
+            const auto end = topic.find('.', begin);
+            levels.push_back(topic.substr(begin, end - begin));
+            if (end == std::string_view::npos) {
+                break;
+            }
+            begin = end + 1;
+        }
+        return levels;
+    }
+
+    TopicIndex with(std::string_view pattern, Subscriber subscriber) const {
+        const auto levels = split(pattern);
+        TopicIndex result;
+        result._root = insert(_root, levels, 0, std::move(subscriber));
+        return result;
+    }
+
+    // Index of many patterns at once, every node is built a single time instead
+    // of the path to it being copied for each pattern.
+    static TopicIndex build(const std::vector<std::pair<std::string, Subscriber>>& patterns) {
+        Builder root;
+        for (const auto& [pattern, subscriber] : patterns) {
+            const auto levels = split(pattern);
+            auto* node = &root;
+            std::size_t i = 0;
+            for (; i < levels.size() && levels[i] != "#"; ++i) {
+                node = &node->children[std::string(levels[i])];
+            }
+            (i == levels.size() ? node->subscribers : node->rest).push_back(subscriber);
+        }
+        TopicIndex result;
+        result._root = freeze(std::move(root));
+        return result;
+    }
+
+    // Appends subscribers interested in topic, every subscriber at most once.
+    void match(std::string_view topic, std::vector<Subscriber>& out) const {
+        const auto first = out.size();
+        const auto levels = split(topic);
+        match(*_root, levels, 0, out);
+        std::sort(std::next(out.begin(), first), out.end());
+        out.erase(std::unique(std::next(out.begin(), first), out.end()), out.end());
+    }
+
+private:
+    struct Builder {
+        std::unordered_map<std::string, Builder> children;
+        std::vector<Subscriber> subscribers;
+        std::vector<Subscriber> rest;
+    };
+
+    static std::shared_ptr<const Node> freeze(Builder&& builder) {
+        auto node = std::make_shared<Node>();
+        node->subscribers = std::move(builder.subscribers);
+        node->rest = std::move(builder.rest);
+        for (auto& [level, child] : builder.children) {
+            node->children.emplace(level, freeze(std::move(child)));
+        }
+        return node;
+    }
+
+    static std::shared_ptr<const Node> insert(
+        const std::shared_ptr<const Node>& node,
+        const std::vector<std::string_view>& levels,
+        std::size_t i,
+        Subscriber subscriber
+    ) {
+        auto copy = node ? std::make_shared<Node>(*node) : std::make_shared<Node>();
+        if (i == levels.size()) {
+            copy->subscribers.push_back(std::move(subscriber));
+        } else if (levels[i] == "#") {
+            copy->rest.push_back(std::move(subscriber));
+        } else {
+            auto& child = copy->children[std::string(levels[i])];
+            child = insert(child, levels, i + 1, std::move(subscriber));
+        }
+        return copy;
+    }
+
+    static void match(
+        const Node& node,
+        const std::vector<std::string_view>& levels,
+        std::size_t i,
+        std::vector<Subscriber>& out
+    ) {
+        out.insert(out.end(), node.rest.begin(), node.rest.end());
+        if (i == levels.size()) {
+            out.insert(out.end(), node.subscribers.begin(), node.subscribers.end());
+            return;
+        }
+        if (const auto it = node.children.find(levels[i]); it != node.children.end()) {
+            match(*it->second, levels, i + 1, out);
+        }
+        if (const auto it = node.children.find(std::string_view("*")); it != node.children.end()) {
+            match(*it->second, levels, i + 1, out);
+        }
+    }
+};
+
+// Set of patterns a single consumer is interested in.
+struct TopicFilter {
+    TopicIndex<int> _patterns;
+
+    TopicFilter() = default;
+    explicit TopicFilter(const std::vector<std::string>& patterns) {
+        std::vector<std::pair<std::string, int>> entries;
+        entries.reserve(patterns.size());
+        for (const auto& pattern : patterns) {
+            entries.emplace_back(pattern, 0);
+        }
+        _patterns = TopicIndex<int>::build(entries);
+    }
+
+    bool matches(std::string_view topic) const {
+        std::vector<int> matched;
+        _patterns.match(topic, matched);
+        return !matched.empty();
+    }
+};
+
+#endif